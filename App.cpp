@@ -2,16 +2,25 @@
 
 #include "actions.hxx"
 #include "ByteArray.hpp"
+#include "dirs.hh"
+#include "DiscovererPool.hpp"
 #include "Duration.hpp"
+#include "FolderWatcher.hpp"
 #include "GstPlayer.hpp"
 #include "gui/Playlist.hpp"
 #include "gui/PlaylistStackWidget.hpp"
 #include "gui/SeekPane.hpp"
 #include "gui/Table.hpp"
 #include "gui/TableModel.hpp"
+#include "Importer.hpp"
 #include "io/File.hpp"
 #include "io/io.hh"
+#include "PlaylistFile.hpp"
+#include "PlaylistJournal.hpp"
+#include "PlaylistLoader.hpp"
 #include "quince.hh"
+#include "Resumer.hpp"
+#include "Saver.hpp"
 #include "Song.hpp"
 
 #include "shared/global_hotkeys.hpp"
@@ -28,6 +37,7 @@
 #include <QMenu>
 #include <QProcessEnvironment>
 #include <QScrollArea>
+#include <QSet>
 #include <QShortcut>
 #include <QStandardPaths>
 #include <QToolBar>
@@ -40,214 +50,15 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+
 static const char *ICON_NAME_PAUSED = "media-playback-pause";
 static const char *ICON_NAME_PLAY = "media-playback-start";
-
-/* Print a tag in a human-readable format (name: value) */
-static void
-print_tag_foreach (const GstTagList *tags, const gchar *tag, gpointer user_data)
-{
-	if (strcmp(tag, "image") == 0)
-		return;
-	
-	GValue val = { 0, };
-	gchar *str_val;
-	gint depth = GPOINTER_TO_INT (user_data);
-	
-	gst_tag_list_copy_value (&val, tags, tag);
-	
-	if (G_VALUE_HOLDS_STRING (&val))
-		str_val = g_value_dup_string (&val);
-	else
-		str_val = gst_value_serialize (&val);
-	
-	g_print ("%*s[print_tag_foreach] %s[%s]: %s\n", 2 * depth, " ",
-		gst_tag_get_nick (tag), tag, str_val);
-	g_free (str_val);
-	
-	g_value_unset (&val);
-}
-
-/* Print information regarding a stream */
-static void print_stream_info (GstDiscovererStreamInfo *info, gint depth) {
-	gchar *desc = NULL;
-	
-	GstCaps *caps = gst_discoverer_stream_info_get_caps (info);
-	
-	if (caps) {
-		if (gst_caps_is_fixed (caps))
-			desc = gst_pb_utils_get_codec_description (caps);
-		else
-			desc = gst_caps_to_string (caps);
-		gst_caps_unref (caps);
-	}
-	
-	g_print ("%*s%s: %s\n", 2 * depth, " ",
-		gst_discoverer_stream_info_get_stream_type_nick (info), (desc ? desc : ""));
-	
-	if (desc) {
-		g_free (desc);
-		desc = NULL;
-	}
-	
-	const GstTagList *tags = gst_discoverer_stream_info_get_tags (info);
-	if (tags) {
-		g_print ("%*sTags:\n", 2 * (depth + 1), " ");
-		gst_tag_list_foreach (tags, print_tag_foreach, GINT_TO_POINTER (depth + 2));
-	}
-}
-
-/* Print information regarding a stream and its substreams, if any */
-static void print_topology (GstDiscovererStreamInfo *info, gint depth) {
-	GstDiscovererStreamInfo *next;
-	
-	if (!info)
-		return;
-	
-	print_stream_info (info, depth);
-	
-	next = gst_discoverer_stream_info_get_next (info);
-	if (next) {
-		print_topology (next, depth + 1);
-		gst_discoverer_stream_info_unref (next);
-	} else if (GST_IS_DISCOVERER_CONTAINER_INFO (info)) {
-		GList *tmp, *streams;
-		
-		streams = gst_discoverer_container_info_get_streams (GST_DISCOVERER_CONTAINER_INFO (info));
-		for (tmp = streams; tmp; tmp = tmp->next) {
-			GstDiscovererStreamInfo *tmpinf = (GstDiscovererStreamInfo *) tmp->data;
-			print_topology (tmpinf, depth + 1);
-		}
-		gst_discoverer_stream_info_list_free (streams);
-	}
-}
-
-/* This function is called every time the discoverer has information
- regarding one of the URIs we provided.*/
-static void on_discovered_cb (GstDiscoverer *discoverer,
-	GstDiscovererInfo *info,
-	GError *err, quince::DiscovererUserParams *user_params)
-{
-	const char *uri = gst_discoverer_info_get_uri (info);
-	GstDiscovererResult result = gst_discoverer_info_get_result (info);
-
-	switch (result)
-	{
-	case GST_DISCOVERER_URI_INVALID:
-		g_print ("Invalid URI '%s'\n", uri);
-		break;
-	case GST_DISCOVERER_ERROR:
-		g_print ("Discoverer error: %s\n", err->message);
-		break;
-	case GST_DISCOVERER_TIMEOUT:
-		g_print ("Timeout\n");
-		break;
-	case GST_DISCOVERER_BUSY:
-		g_print ("Busy\n");
-		break;
-	case GST_DISCOVERER_MISSING_PLUGINS:{
-		const GstStructure *s;
-		gchar *str;
-		
-		s = gst_discoverer_info_get_misc (info);
-		str = gst_structure_to_string (s);
-		
-		g_print ("Missing plugins: %s\n", str);
-		g_free (str);
-		break;
-	}
-	case GST_DISCOVERER_OK:
-		//g_print ("Discovered '%s'\n", uri);
-		break;
-	}
-	
-	if (result != GST_DISCOVERER_OK) {
-		mtl_trace("This URI cannot be played: %d, uri: \"%s\"",
-			result, uri);
-		return;
-	}
-	
-	/* If we got no error, show the retrieved information */
-	u64 nano = gst_discoverer_info_get_duration(info);
-	quince::audio::Info audio_info = {.duration = nano, .uri = uri};
-	
-	if (false)
-	{
-		const GstTagList *tags = gst_discoverer_info_get_tags (info);
-		if (tags) {
-			g_print ("Tags:\n");
-			gst_tag_list_foreach (tags, print_tag_foreach, GINT_TO_POINTER (1));
-		}
-		
-		g_print ("Seekable: %s\n", (gst_discoverer_info_get_seekable (info) ? "yes" : "no"));
-	}
-	
-	if (true)
-	{
-		GstDiscovererStreamInfo *sinfo = gst_discoverer_info_get_stream_info (info);
-
-		if (sinfo)
-		{
-//			print_topology (sinfo, 1);
-			GList *audio_streams = gst_discoverer_info_get_audio_streams(info);
-			for (auto *l = audio_streams; l != NULL; l = l->next)
-			{
-				auto *discov_audio_info = (GstDiscovererAudioInfo*)l->data;
-				audio_info.bitrate = gst_discoverer_audio_info_get_bitrate(discov_audio_info);
-				audio_info.channels =  gst_discoverer_audio_info_get_channels(discov_audio_info);
-				audio_info.sample_rate = gst_discoverer_audio_info_get_sample_rate(discov_audio_info);
-			}
-			
-			gst_discoverer_stream_info_unref (sinfo);
-		}
-	}
-	
-	// Now find the quince::Song with corresponding uri and discoverer,
-	// then update the Song and the GUI.
-	auto item = user_params->pending.find(user_params->discoverer);
-	
-	auto *table_model = user_params->app->active_table_model();
-	CHECK_PTR_VOID(table_model);
-	quince::gui::Playlist *playlist = user_params->app->active_playlist();
-	CHECK_PTR_VOID(playlist);
-	
-	if (item != user_params->pending.end()) {
-		std::vector<quince::Song*> &vec = item->second;
-		
-		for (int i = 0; i < vec.size(); i++) {
-			quince::Song *song = vec[i];
-			
-			if (song->uri() == uri) {
-				song->Apply(audio_info);
-				table_model->UpdateRangeDefault(i);
-				quince::gui::SeekPane *seek_pane = user_params->app->seek_pane();
-				
-				if (seek_pane->IsActive(song)) {
-					quince::audio::PlaylistSong pair = {playlist->id(), song};
-					seek_pane->SetCurrentOrUpdate(pair);
-				}
-			}
-		}
-	}
-}
-
-/* This function is called when the discoverer has finished examining
- * all the URIs we provided.*/
-static void on_finished_cb (GstDiscoverer *discoverer,
-	quince::DiscovererUserParams *user_params)
-{
-	 // cleanup map
-		auto item = user_params->pending.find(user_params->discoverer);
-		
-		if (item != user_params->pending.end())
-			user_params->pending.erase(item);
-	
-	gst_discoverer_stop (user_params->discoverer); // Stop the discoverer process
-	g_object_unref (user_params->discoverer); // Free resources
-	g_main_loop_quit (user_params->loop);
-	g_main_loop_unref (user_params->loop);
-	user_params->loop = nullptr;
-}
+static const int MaxDiscoverers = 4;
+static const GstClockTime DiscoverTimeout = 10 * GST_SECOND;
+static const int MaxWarmPipelines = 3; // see WarmPool
+static const i64 PrefetchBytes = 4 * 1024 * 1024; // see Prefetcher
+static const int MaxFolderDepth = 32; // levels of dropped and watched folders
 
 static void HotkeyCallback(const QuinceGlobalHotkeysAction action)
 {
@@ -281,9 +92,13 @@ app_icon_(":/resources/Quince.png")
 	DetectDesktop();
 	setObjectName(quince_context_.unique);
 	play_mode_ = audio::PlayMode::StopAtPlaylistEnd;
-	player_ = new GstPlayer(this, argc, argv);
-	CHECK_TRUE_VOID(InitDiscoverer());
+	player_ = new GstPlayer(this, argc, argv, MaxWarmPipelines,
+		PrefetchBytes);
+	saver_ = new Saver(this);
+	discoverers_ = new DiscovererPool(this, MaxDiscoverers, DiscoverTimeout);
 	CHECK_TRUE_VOID(CreateGui());
+	importer_ = new Importer(this, MaxFolderDepth);
+	loader_ = new PlaylistLoader(this);
 	LoadPlaylists();
 	setWindowIcon(app_icon_);
 	InitTrayIcon();
@@ -294,15 +109,21 @@ app_icon_(":/resources/Quince.png")
 
 App::~App()
 {
+	for (gui::Playlist *playlist: playlists_)
+		playlist->watcher(nullptr); // their events are of no use anymore
+	
+	delete loader_; // playlists that weren't loaded aren't saved either
+	loader_ = nullptr;
+	delete discoverers_;
+	discoverers_ = nullptr;
+	delete importer_;
+	importer_ = nullptr;
 	SavePlaylistsToDisk();
+	SaveResumePoint();
+	delete saver_; // waits for the playlists to be written
+	saver_ = nullptr;
 	delete player_;
 	
-	if (user_params_.loop != nullptr) {
-		g_main_loop_quit (user_params_.loop);
-		g_main_loop_unref (user_params_.loop);
-		user_params_.loop = nullptr;
-	}
-	
 
 // ==>int QStackedWidget::addWidget(QWidget *widget)<==
 // Ownership of widget is passed on to the QStackedWidget.
@@ -340,50 +161,13 @@ App::active_table_model()
 	return active_playlist_->table_model();
 }
 
-bool
+void
 App::AddBatch(QVector<quince::Song*> &vec)
 {
-	bool started = false;
-
-	for (quince::Song *song: vec)
-	{
-		QUrl url(song->uri());
-		QByteArray full_path_ba = url.toLocalFile().toLocal8Bit();
-		const char *full_path = full_path_ba.data();
-		audio::Meta &meta = song->meta();
-		audio::ReadFileMeta(full_path, meta);
-		
-//		if (song->meta().is_duration_set())
-//			continue;
-		
-		if (!started) {
-			// Start the discoverer process (nothing to do yet)
-			gst_discoverer_start (user_params_.discoverer);
-			started = true;
-		}
-		
-		// Add an asynchronous request to process the URI
-		auto uri_ba = song->uri().toLocal8Bit();
-//		mtl_info("Adding request for %s", uri_ba.data());
-		
-		if (!gst_discoverer_discover_uri_async (user_params_.discoverer, uri_ba)) {
-			mtl_warn("Failed to start discovering URI '%s'\n", uri_ba.data());
-			g_object_unref (user_params_.discoverer);
-			return false;
-		}
-		
-		std::vector<quince::Song*> &vec = user_params_.pending[user_params_.discoverer];
-		vec.push_back(song);
-	}
-	
-	if (started)
-	{
-		// Create a GLib Main Loop and set it to run, so we can wait for the signals
-		user_params_.loop = g_main_loop_new (NULL, FALSE);
-		g_main_loop_run (user_params_.loop);
-	}
-
-	return true;
+	// The tags were already parsed by the Importer's worker threads,
+	// these are the songs no native probe could fully read (see
+	// audio::FindProbe()).
+	discoverers_->Add(vec);
 }
 
 QAction*
@@ -400,81 +184,19 @@ App::AddAction(QToolBar *tb, const QString &icon_name,
 	return action;
 }
 
-void
-App::AddFolderTo(const io::File &dir, QVector<io::File> &only_files, const int level,
-	const int max_levels)
-{
-	if (level >= max_levels)
-		return;
-	
-	QVector<io::File> subfiles;
-	QString dir_path = dir.build_full_path();
-	
-	if (io::ListFiles(dir_path, subfiles, 0, io::IsSongExtension) != io::Err::Ok) {
-		auto ba = dir_path.toLocal8Bit();
-		mtl_trace("dir path: %s", ba.data());
-		return;
-	}
-	
-	for (io::File &file: subfiles) {
-		if (file.is_regular())
-			only_files.append(file);
-	}
-	
-	for (io::File &file: subfiles)
-	{
-		if (file.is_dir()) {
-			AddFolderTo(file, only_files, level + 1, max_levels);
-		}
-	}
-}
-
 void
 App::AddFilesToPlaylist(QVector<io::File> &files,
 	gui::Playlist *playlist, i32 at_vec_index)
 {
 //	mtl_info("Insert at %d", at_vec_index);
 	CHECK_PTR_VOID(playlist);
-	gui::TableModel *model = playlist->table_model();
-	QVector<Song*> songs_to_add;
-	QVector<io::File> only_files;
+	EnsureLoaded(playlist);
 	
-	for (io::File &file: files)
-	{
-		if (file.is_regular())
-			only_files.append(file);
-	}
-	
-	for (io::File &file: files)
-	{
-		if (file.is_dir()) {
-			AddFolderTo(file, only_files, 0, 3);
-		}
-	}
-	
-	for (io::File &file: only_files)
-	{
-		auto *song = Song::FromFile(file, playlist->id());
-		
-		if (song != nullptr) {
-			songs_to_add.append(song);
-		} else {
-			// mtl_warn("Song is null: \"%s\"", song_path.data());
-		}
-	}
+	if (at_vec_index > playlist->songs().size())
+		at_vec_index = playlist->songs().size();
 	
-	if (!songs_to_add.isEmpty())
-	{
-		QVector<Song*> &songs = playlist->songs();
-		
-		if (at_vec_index >= songs.size())
-			at_vec_index = songs.size();
-		
-		AddBatch(songs_to_add);
-		model->InsertRows(at_vec_index, songs_to_add);
-		SavePlaylistSimple(playlist);
-		UpdatePlaylistDuration(playlist);
-	}
+	// Rows show up and get saved as the Importer delivers them
+	importer_->Import(files, playlist, at_vec_index);
 }
 
 void
@@ -605,10 +327,38 @@ App::AskRenamePlaylist()
 	}
 	
 	current->name(new_name);
-	CHECK_TRUE_VOID(SavePlaylistSimple(current));
+	current->journal().Rename(new_name);
+	CHECK_TRUE_VOID(SavePlaylistEdits(current));
 	playlists_cb_->setItemText(index, new_name);
 }
 
+void
+App::AskWatchFolder()
+{
+	gui::Playlist *playlist = GetComboCurrentPlaylist();
+	CHECK_PTR_VOID(playlist);
+	const QString dir_path = QFileDialog::getExistingDirectory(this,
+		QLatin1String("Watch Folder"));
+	
+	if (dir_path.isEmpty())
+		return;
+	
+	if (playlist->watcher() == nullptr)
+	{
+		QString full_path;
+		CHECK_TRUE_VOID(playlist->GetFullPath(full_path));
+		playlist->watcher(new FolderWatcher(this, playlist->id(),
+			FolderWatcher::PathFor(full_path), MaxFolderDepth));
+	}
+	
+	playlist->watcher()->AddRoot(dir_path);
+	EnsureLoaded(playlist);
+	
+	// Otherwise it's started once the songs are loaded
+	if (playlist->loaded())
+		playlist->watcher()->Start();
+}
+
 void
 App::closeEvent(QCloseEvent *event)
 {
@@ -728,6 +478,10 @@ App::CreatePlaylistActionsToolBar()
 	AddAction(tb, "list-add", actions::PlaylistNew, "New Playlist");
 	AddAction(tb, "list-remove", actions::PlaylistDelete, "Delete Playlist");
 	AddAction(tb, "document-properties", actions::PlaylistRename, "Rename Playlist");
+	AddAction(tb, "folder-sync", actions::PlaylistWatchFolder,
+		"Keep the playlist in sync with a folder");
+	AddAction(tb, "process-stop", actions::PlaylistStopWatching,
+		"Stop syncing the playlist with folders");
 	
 	playlists_cb_ = new QComboBox();
 	playlists_cb_->setSizeAdjustPolicy(QComboBox::AdjustToContents);
@@ -768,6 +522,9 @@ App::DeletePlaylist(gui::Playlist *p, int index)
 	const bool was_active = (p == active_playlist_);
 	QString full_path;
 	CHECK_TRUE(p->GetFullPath(full_path));
+	loader_->Cancel(p->id());
+	saver_->Cancel(p->id());
+	p->watcher(nullptr);
 	auto ba = full_path.toLocal8Bit();
 	int ret = remove(ba.data());
 	
@@ -775,7 +532,15 @@ App::DeletePlaylist(gui::Playlist *p, int index)
 		mtl_warn("Failed to delete file \"%s\"", ba.data());
 		return false;
 	}
+	
+	auto journal_ba = PlaylistJournal::PathFor(full_path).toLocal8Bit();
+	remove(journal_ba.data());
+	auto watch_ba = FolderWatcher::PathFor(full_path).toLocal8Bit();
+	remove(watch_ba.data());
 
+	for (Song *song: p->songs())
+		ForgetPendingSong(song);
+	
 	playlists_cb_->removeItem(index);
 	playlists_.removeAt(index);
 	playlist_stack_->removeWidget(p);
@@ -808,6 +573,25 @@ App::DetectDesktop()
 	}
 }
 
+void
+App::EnsureLoaded(gui::Playlist *playlist)
+{
+	CHECK_PTR_VOID(playlist);
+	
+	if (!playlist->loaded())
+		loader_->Load(playlist->id());
+}
+
+void
+App::ForgetPendingSong(Song *song)
+{
+	if (importer_ != nullptr)
+		importer_->Forget(song);
+	
+	if (discoverers_ != nullptr)
+		discoverers_->Cancel(song);
+}
+
 i64
 App::GenNewPlaylistId() const
 {
@@ -957,29 +741,6 @@ App::GetVisiblePlaylistCurrentSong(int *pindex)
 	return nullptr;
 }
 
-bool
-App::InitDiscoverer()
-{
-	user_params_.app = this;
-	
-	// Instantiate the Discoverer
-	GError *err = NULL;
-	user_params_.discoverer = gst_discoverer_new (30 * GST_SECOND, &err);
-	
-	if (!user_params_.discoverer)
-	{
-		g_print ("Error creating discoverer instance: %s\n", err->message);
-		g_clear_error (&err);
-		return false;
-	}
-	
-	// Connect to the interesting signals
-	g_signal_connect (user_params_.discoverer, "discovered", G_CALLBACK (on_discovered_cb), &user_params_);
-	g_signal_connect (user_params_.discoverer, "finished", G_CALLBACK (on_finished_cb), &user_params_);
-	
-	return true;
-}
-
 void
 App::InitTrayIcon()
 {
@@ -1038,7 +799,7 @@ App::InitTrayIcon()
 }
 
 bool
-App::LoadPlaylist(const QString &full_path)
+App::LoadLegacyPlaylist(const QString &full_path)
 {
 	ByteArray ba;
 	
@@ -1051,11 +812,11 @@ App::LoadPlaylist(const QString &full_path)
 	
 	i32 cache_version = ba.next_i32();
 	
-	if (cache_version != quince::PlaylistCacheVersion)
+	if (cache_version != quince::PlaylistCacheVersionLegacy)
 	{
 //		auto ba = full_path.toLocal8Bit();
 //		mtl_info("Playlist cache version %d not supported, need %d, file:\n%s",
-//			cache_version, quince::PlaylistCacheVersion, ba.data());
+//			cache_version, quince::PlaylistCacheVersionLegacy, ba.data());
 		return false;
 	}
 	
@@ -1073,7 +834,7 @@ App::LoadPlaylist(const QString &full_path)
 	
 	for (i32 i = 0; i < song_count; i++)
 	{
-		Song *song = Song::From(ba, playlist->id());
+		Song *song = Song::FromLegacy(ba, playlist->id());
 		
 		if (song != nullptr)
 			songs_to_add.append(song);
@@ -1088,6 +849,64 @@ App::LoadPlaylist(const QString &full_path)
 	return true;
 }
 
+bool
+App::LoadPlaylist(const QString &full_path, gui::Playlist **active)
+{
+	auto *file = new PlaylistFile();
+	
+	if (!file->Map(full_path))
+	{
+		delete file;
+		auto path = full_path.toLocal8Bit();
+		mtl_trace("Couldn't read file: %s", path.data());
+		return false;
+	}
+	
+	if (file->version() == PlaylistCacheVersionLegacy) {
+		delete file;
+		return LoadLegacyPlaylist(full_path);
+	}
+	
+	if (!file->Validate())
+	{
+//		auto ba = full_path.toLocal8Bit();
+//		mtl_info("Playlist cache version %d not supported, need %d, file:\n%s",
+//			file->version(), quince::PlaylistCacheVersion, ba.data());
+		delete file;
+		return false;
+	}
+	
+	// Only the header is read here, the songs are
+	// created by the loader (see PlaylistLoaded()).
+	const PlaylistHeader *header = file->header();
+	auto *playlist = CreatePlaylist(file->name(), false,
+		PlaylistActivationOption::None, nullptr,
+		gui::playlist::Ctor::None);
+	
+	if (playlist == nullptr) {
+		delete file;
+		mtl_trace();
+		return false;
+	}
+	
+	playlist->id(header->id);
+	playlist->loaded(false);
+	
+	const QString watch_path = FolderWatcher::PathFor(full_path);
+	auto watch_ba = watch_path.toLocal8Bit();
+	
+	if (io::FileExists(watch_ba.data()))
+		playlist->watcher(new FolderWatcher(this, playlist->id(), watch_path,
+			MaxFolderDepth));
+	
+	if (header->is_active == 1)
+		*active = playlist;
+	
+	loader_->Add(playlist->id(), full_path, file);
+	
+	return true;
+}
+
 void
 App::LoadPlaylists()
 {
@@ -1102,13 +921,31 @@ App::LoadPlaylists()
 	if (io::ListFileNames(dir_path, names) != io::Err::Ok)
 		return;
 	
+	gui::Playlist *active = nullptr;
+	
 	for (const QString &filename: names) {
-		LoadPlaylist(dir_path + filename);
+		if (filename.endsWith(QLatin1String(".tmp")))
+			continue; // left over from an interrupted save
+		
+		if (filename.endsWith(QLatin1String(".journal")) ||
+			filename.endsWith(QLatin1String(".watch")))
+			continue;
+		
+		LoadPlaylist(dir_path + filename, &active);
 	}
 	
+	// The active playlist gets loaded right away, the rest in the background
+	if (active != nullptr)
+		SetActive(active, PlaylistActivationOption::RestoreStreamPosition);
+	
 	int visible_playlist_index = -1;
-	GetVisiblePlaylist(&visible_playlist_index);
+	gui::Playlist *visible_playlist = GetVisiblePlaylist(&visible_playlist_index);
+	
+	if (visible_playlist != nullptr)
+		EnsureLoaded(visible_playlist);
+	
 	UpdatePlaylistsVisibility(visible_playlist_index);
+	loader_->Start();
 	
 	{ // this fixes gui/playback glitches
 		// not sure if it's still the case
@@ -1240,6 +1077,28 @@ App::PickSong(QVector<Song*> *vec, const int current_song_index,
 	}
 }
 
+audio::PlaylistSong
+App::PeekNextSong()
+{ // like PickSong(Next) while playing, but changes nothing. Past the
+// end it's none unless repeating, EOS then handles it the usual way.
+	audio::PlaylistSong next = {-1, nullptr};
+	auto *vec = active_playlist_songs();
+	int index = -1;
+	
+	if (vec == nullptr || GetCurrentSong(&index) == nullptr)
+		return next;
+	
+	if (index < vec->size() - 1)
+		next.song = (*vec)[index + 1];
+	else if (play_mode_ == audio::PlayMode::RepeatPlaylist)
+		next.song = GetFirstSongInCurrentPlaylist();
+	
+	if (next.song != nullptr)
+		next.playlist_id = active_playlist_->id();
+	
+	return next;
+}
+
 GstElement*
 App::play_elem() const { return player_->play_elem(); }
 
@@ -1253,6 +1112,45 @@ App::PlaylistComboIndexChanged(int index)
 	UpdatePlaylistsVisibility(index);
 }
 
+void
+App::PlaylistLoaded(load::Result &result)
+{
+	int index;
+	gui::Playlist *playlist = PickPlaylist(result.id, &index);
+	
+	if (playlist == nullptr || playlist->loaded())
+	{
+		for (Song *song: result.songs)
+			delete song;
+		
+		delete result.file;
+		return;
+	}
+	
+	if (playlist->name() != result.name) { // renamed in the journal
+		playlist->name(result.name);
+		playlists_cb_->setItemText(index, result.name);
+	}
+	
+	playlist->journal().Restart(result.generation, result.file->size(),
+		result.journal_size);
+	gui::TableModel *model = playlist->table_model();
+	model->AdoptFile(result.file);
+	model->InsertRows(0, result.songs);
+	playlist->loaded(true);
+	
+	if (result.outdated) { // gets saved in full with the file ids
+		playlist->journal().Invalidate();
+		SavePlaylistEdits(playlist);
+	}
+	
+	if (playlist->watcher() != nullptr)
+		playlist->watcher()->Start();
+	
+	if (playlist == GetVisiblePlaylist())
+		UpdatePlaylistDuration(playlist);
+}
+
 Song*
 App::PlaySong(const audio::Pick direction)
 {
@@ -1283,17 +1181,8 @@ void
 App::PlayStop()
 {
 	audio::TempSongInfo &tsi = player_->temp_song_info();
-	Song *song = tsi.song;
 	quince::audio::PlaylistSong pair = {tsi.playlist_id, tsi.song};
-	player_->StopPlaying(pair);
-	
-	if (song != nullptr) {
-		int index;
-		gui::Playlist *p = GetPlaylistById(tsi.playlist_id, &index);
-		CHECK_PTR_VOID(p);
-		active_table_model()->UpdateRangeDefault(index);
-	}
-	
+	player_->StopPlaying(pair); // refreshes the song's row
 	UpdatePlayIcon(GST_STATE_NULL);
 }
 
@@ -1326,6 +1215,10 @@ App::ProcessAction(const QString &action_name)
 		AskDeletePlaylist();
 	} else if (action_name == actions::PlaylistRemoveAllEntries) {
 		RemoveSongsFromPlaylist(Which::All);
+	} else if (action_name == actions::PlaylistWatchFolder) {
+		AskWatchFolder();
+	} else if (action_name == actions::PlaylistStopWatching) {
+		StopWatchingFolders();
 	} else if (action_name == actions::ShowHideWindow) {
 		TrayActivated();
 	} else {
@@ -1334,6 +1227,17 @@ App::ProcessAction(const QString &action_name)
 	}
 }
 
+void
+App::PlaylistSaveFailed(const i64 id)
+{
+	gui::Playlist *playlist = PickPlaylist(id);
+	
+	// Whatever is on disk now can't be appended to,
+	// the next edit saves the playlist in full.
+	if (playlist != nullptr)
+		playlist->journal().Invalidate();
+}
+
 bool
 App::QueryAppConfigPath(QString &path)
 {
@@ -1519,7 +1423,7 @@ App::RemoveSongsFromPlaylist(const Which which)
 	
 	if (count > 0) {
 		UpdatePlaylistDuration(playlist);
-		SavePlaylistSimple(playlist);
+		SavePlaylistEdits(playlist);
 	}
 }
 
@@ -1528,32 +1432,51 @@ App::SavePlaylist(gui::Playlist *playlist, const QString &dir_path,
 const bool is_active)
 {
 	CHECK_PTR(playlist);
-	quince::ByteArray ba;
-	ba.add_i32(PlaylistCacheVersion);
-	ba.add_i64(playlist->id());
-	ba.add_string(playlist->name());
-	ba.add_u8(is_active ? 1 : 0);
-	auto &songs = playlist->songs();
-	const i32 count = songs.size();
-	ba.add_i32(count);
 	
-	for (int i = 0; i < count; i++)
-	{
-		songs[i]->SaveTo(ba);
-	}
+	// Its file is what would get saved anyway, and there might
+	// be nothing in memory yet to save.
+	if (!playlist->loaded())
+		return true;
 	
-//	ba.to(sizeof(i32));
-//	QString s = ba.next_string();
-//	auto s_ba = s.toLocal8Bit();
-//	mtl_info("Playlist name: \"%s\"", s_ba.data());
+	PlaylistJournal &journal = playlist->journal();
+	const i64 generation = journal.generation() + 1;
+	quince::ByteArray ba;
+	PlaylistFile::Serialize(playlist->songs(), playlist->id(),
+		playlist->name(), is_active, generation, ba);
 	
 	QString full_path = dir_path + QChar('/')
 		+ QString::number(playlist->id());
 	
-	if (io::WriteToFile(full_path, ba.data(), ba.size()) != io::Err::Ok) {
-		mtl_warn("Error occured writing to file");
-		return false;
-	}
+	// Written on the saver's thread, which replaces the file rather than
+	// truncating it since the songs might still be reading their strings
+	// from the old (mapped) file.
+	saver_->Replace(playlist->id(), full_path, QByteArray(ba.data(), ba.size()));
+	
+	// The journal on disk is stale now (older generation),
+	// the next edit starts it over.
+	journal.Restart(generation, ba.size());
+	
+	return true;
+}
+
+bool
+App::SavePlaylistEdits(gui::Playlist *playlist)
+{
+	CHECK_PTR(playlist);
+	PlaylistJournal &journal = playlist->journal();
+	
+	if (journal.must_compact())
+		return SavePlaylistSimple(playlist);
+	
+	if (!journal.has_pending())
+		return true;
+	
+	QString full_path;
+	CHECK_TRUE(playlist->GetFullPath(full_path));
+	QByteArray bytes;
+	bool create;
+	journal.Commit(bytes, create);
+	saver_->Append(playlist->id(), full_path, bytes, create);
 	
 	return true;
 }
@@ -1568,6 +1491,20 @@ App::SavePlaylistSimple(gui::Playlist *playlist)
 	return SavePlaylist(playlist, dir_path, is_active);
 }
 
+void
+App::SaveResumePoint()
+{
+	Song *song = nullptr;
+	
+	if (active_playlist_ != nullptr)
+		song = active_playlist_->GetCurrentSong(nullptr);
+	
+	if (song != nullptr)
+		Resumer::Save(song->uri(), song->position());
+	else
+		Resumer::Save(QString(), -1);
+}
+
 void
 App::SavePlaylistState(const i64 id)
 {
@@ -1583,12 +1520,10 @@ App::SavePlaylistState(const i64 id)
 	CHECK_PTR_VOID(playlist);
 	Song *song = playlist->GetCurrentSong(nullptr);
 	
-	if (song != nullptr)
-	{
-		if (song->is_playing())
-			song->state(GST_STATE_PAUSED);
+	if (song != nullptr && song->is_playing()) {
+		song->state(GST_STATE_PAUSED);
+		playlist->table_model()->Changed(song);
 	}
-	
 }
 
 bool
@@ -1598,6 +1533,9 @@ App::SavePlaylistsToDisk()
 	CHECK_TRUE(gui::Playlist::QuerySaveFolder(path));
 	bool ok = true;
 	
+	// The clock doesn't run while hidden to the tray
+	UpdatePlayingSongPosition(-1, false);
+	
 	for (gui::Playlist *p : playlists_)
 	{
 		if (!SavePlaylist(p, path, p == active_playlist_))
@@ -1626,6 +1564,7 @@ App::SetActive(gui::Playlist *playlist, const PlaylistActivationOption option)
 		return;
 	
 	executing = true;
+	EnsureLoaded(playlist);
 //	auto ba = playlist->name().toLocal8Bit();
 //	mtl_info("set active(%s): %d", ba.data(), int(option));
 	active_playlist_ = playlist;
@@ -1643,13 +1582,29 @@ App::SetActive(gui::Playlist *playlist, const PlaylistActivationOption option)
 		Song *song = playlist->GetCurrentSong(nullptr);
 		
 		if (song != nullptr)
-			player_->SetSeekAndPause_Start(song, nullptr);
+			player_->Resume(song);
 	}
 	
 	last_playlist_id_ = playlist->id();
 	executing = false;
 }
 
+void
+App::StopWatchingFolders()
+{ // the songs found so far stay in the playlist
+	gui::Playlist *playlist = GetComboCurrentPlaylist();
+	CHECK_PTR_VOID(playlist);
+	
+	if (playlist->watcher() == nullptr)
+		return;
+	
+	playlist->watcher(nullptr);
+	QString full_path;
+	CHECK_TRUE_VOID(playlist->GetFullPath(full_path));
+	auto ba = FolderWatcher::PathFor(full_path).toLocal8Bit();
+	remove(ba.data());
+}
+
 void
 App::TrayActivated() //QSystemTrayIcon::ActivationReason reason)
 {
@@ -1664,10 +1619,15 @@ App::TrayActivated() //QSystemTrayIcon::ActivationReason reason)
 	UpdatePlaylistsVisibility(visible_playlist_index);
 	
 	if (visible())
-	{
+	{ // what changed while hidden shows up now
+		for (gui::Playlist *playlist: playlists_)
+			playlist->table_model()->FlushChanges();
+		
 		activateWindow();
 		raise();
 	}
+	
+	player_->WindowShown(visible());
 }
 
 void
@@ -1703,6 +1663,7 @@ App::UpdatePlayingSongPosition(const i64 new_pos, const bool update_gui)
 	
 	if (SongAndPlaylistMatch(tsi)) {
 		tsi.song->position(tsi.position);
+		player_->PositionChanged(tsi);
 		
 		if (update_gui)
 			seek_pane_->UpdatePosition(tsi.position);
@@ -1748,4 +1709,135 @@ App::UpdatePlaylistsVisibility(const int index) {
 	}
 }
 
+void
+App::WatchedFoldersChanged(const i64 playlist_id,
+	std::vector<watch::Event> &events)
+{
+	gui::Playlist *playlist = PickPlaylist(playlist_id);
+	
+	if (playlist == nullptr)
+		return;
+	
+	FolderWatcher *watcher = playlist->watcher();
+	
+	if (!playlist->loaded()) {
+		if (watcher != nullptr)
+			watcher->Persisted();
+		return;
+	}
+	
+	gui::TableModel *model = playlist->table_model();
+	PlaylistJournal &journal = playlist->journal();
+	QSet<Song*> gone; // removed from the model at the end, in one go
+	
+	// Found by path through the model's index of songs per folder
+	auto split = [] (const QByteArray &path, u32 &dir_id, QString &name) {
+		const int slash = path.lastIndexOf('/');
+		dir_id = dirs::Intern(QString::fromLocal8Bit(path.constData(), slash));
+		name = QString::fromLocal8Bit(path.constData() + slash + 1);
+	};
+	
+	auto find = [model, &gone, &split] (const QByteArray &path) -> Song* {
+		u32 dir_id;
+		QString name;
+		split(path, dir_id, name);
+		Song *song = model->Find(dir_id, name);
+		return (song == nullptr || gone.contains(song)) ? nullptr : song;
+	};
+	
+	// A new path is journaled as the song replacing itself
+	auto relocate = [model, &journal] (Song *song, const u32 dir_id,
+		const QString &name) {
+		const i32 row = model->RowOf(song);
+		model->FileMoved(song, dir_id, name);
+		journal.Remove(row, 1);
+		journal.Insert(row, {song});
+	};
+	
+	QVector<io::File> added;
+	bool edited = false;
+	
+	for (const watch::Event &event: events)
+	{
+		switch (event.type)
+		{
+		case watch::EventType::Added: {
+			if (find(event.path) == nullptr)
+				added.append(event.file);
+			break;
+		}
+		case watch::EventType::Removed: {
+			Song *song = find(event.path);
+			
+			if (song != nullptr)
+				gone.insert(song);
+			break;
+		}
+		case watch::EventType::Moved: {
+			Song *song = find(event.path);
+			
+			if (song == nullptr)
+				break;
+			
+			u32 dir_id;
+			QString name;
+			split(event.new_path, dir_id, name);
+			relocate(song, dir_id, name);
+			edited = true;
+			break;
+		}
+		case watch::EventType::DirRemoved: {
+			for (const u32 id: model->DirsUnder(QString::fromLocal8Bit(event.path)))
+			{
+				for (Song *song: model->SongsIn(id))
+					gone.insert(song);
+			}
+			break;
+		}
+		case watch::EventType::DirMoved: {
+			const QString from = QString::fromLocal8Bit(event.path);
+			const QString to = QString::fromLocal8Bit(event.new_path);
+			
+			for (const u32 id: model->DirsUnder(from))
+			{
+				const u32 new_id = dirs::Intern(to + dirs::Get(id).mid(from.size()));
+				
+				for (Song *song: model->SongsIn(id))
+				{
+					if (!gone.contains(song))
+						relocate(song, new_id, song->filename());
+				}
+				
+				edited = true;
+			}
+			break;
+		}
+		}
+	}
+	
+	QVector<i32> removed;
+	removed.reserve(gone.size());
+	
+	for (Song *song: gone)
+		removed.append(model->RowOf(song));
+	
+	if (!removed.isEmpty() && model->RemoveRows(removed) > 0)
+		edited = true;
+	
+	if (edited)
+	{
+		if (playlist == GetVisiblePlaylist())
+			UpdatePlaylistDuration(playlist);
+		
+		SavePlaylistEdits(playlist);
+	}
+	
+	// Appended, the importer saves them as they show up and then lets
+	// the watcher save its state, which must not be ahead of the playlist.
+	if (!added.isEmpty())
+		importer_->Import(added, playlist, model->songs().size(), true);
+	else if (watcher != nullptr)
+		watcher->Persisted();
+}
+
 } // quince::
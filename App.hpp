@@ -20,18 +20,15 @@
 
 #include <kglobalaccel.h>
 
+#include <vector>
+
 namespace quince {
 
-static const i32 PlaylistCacheVersion = 3;
+static const i32 PlaylistCacheVersion = 6; // see PlaylistFile.hpp
+static const i32 PlaylistCacheVersionNoFileIDs = 5;
+static const i32 PlaylistCacheVersionLegacy = 3;
 static const QString AppConfigName = QLatin1String("QuincePlayer");
 
-struct DiscovererUserParams {
-	GstDiscoverer *discoverer;
-	GMainLoop *loop;
-	quince::App *app;
-	std::unordered_map<GstDiscoverer*, std::vector<Song*>> pending;
-};
-
 enum class Which : u8 {
 	All,
 	Selected
@@ -46,7 +43,7 @@ public:
 	gui::Playlist* active_playlist() const { return active_playlist_; }
 	QVector<Song*>* active_playlist_songs();
 	gui::TableModel* active_table_model();
-	bool AddBatch(QVector<quince::Song*> &vec);
+	void AddBatch(QVector<quince::Song*> &vec);
 	void AddFilesToPlaylist(QVector<io::File> &files, gui::Playlist *playlist, i32 at_vec_index);
 	gui::Playlist* CreatePlaylist(const QString &name, const bool set_active,
 		const PlaylistActivationOption activation_option,
@@ -61,6 +58,8 @@ public:
 	desktop_kde() const { return desktop_ == Desktop::KDE; }
 	
 	void DetectDesktop();
+	void EnsureLoaded(gui::Playlist *playlist);
+	void ForgetPendingSong(Song *song);
 	
 	gui::Playlist* GetComboCurrentPlaylist(int *pindex = nullptr);
 	Song* GetCurrentSong(int *index = nullptr);
@@ -69,7 +68,7 @@ public:
 	int GetIndex(gui::Playlist *playlist) const;
 	gui::Playlist* GetVisiblePlaylist(int *ret_index = nullptr);
 	Song* GetVisiblePlaylistCurrentSong(int *pindex);
-	bool InitDiscoverer();
+	Importer* importer() const { return importer_; }
 	
 	bool visible() const { return must_be_visible_; }
 	void visible(const bool flag) { must_be_visible_ = flag; }
@@ -80,7 +79,9 @@ public:
 	void MediaPlayPause();
 	void MessageAsyncDone();
 	gui::Playlist* PickPlaylist(const i64 id, int *pindex = nullptr);
+	audio::PlaylistSong PeekNextSong();
 	void PlaylistComboIndexChanged(int index);
+	void PlaylistLoaded(load::Result &result);
 	GstElement* play_elem() const;
 	GstPlayer* player() const { return player_; }
 	Song *PlaySong(const audio::Pick direction);
@@ -89,6 +90,10 @@ public:
 	void ReachedEndOfStream();
 	void RemoveSongsFromPlaylist(const Which which);
 	bool SavePlaylistsToDisk();
+	void PlaylistSaveFailed(const i64 id);
+	bool SavePlaylistEdits(gui::Playlist *playlist);
+	void SaveResumePoint();
+	bool SavePlaylistSimple(gui::Playlist *playlist);
 	void SetActive(gui::Playlist *playlist, const PlaylistActivationOption option);
 	gui::SeekPane* seek_pane() const { return seek_pane_; }
 	void TrayActivated();
@@ -96,6 +101,7 @@ public:
 	void UpdatePlaylistDuration(gui::Playlist *playlist);
 	void UpdatePlayingSongPosition(const i64 new_pos, const bool update_gui);
 	void UpdatePlaylistsVisibility(const int index);
+	void WatchedFoldersChanged(const i64 playlist_id, std::vector<watch::Event> &events);
 protected:
 	void closeEvent(QCloseEvent *event);
 	
@@ -105,12 +111,11 @@ private:
 	AddAction(QToolBar *tb, const QString &icon_name,
 		const QString &action_name, const char *tooltip = nullptr);
 	
-	void AddFolderTo(const io::File &dir, QVector<io::File> &only_files,
-		const int level, const int max_levels);
 	void AskAddSongFilesToPlaylist();
 	void AskDeletePlaylist();
 	void AskNewPlaylist();
 	void AskRenamePlaylist();
+	void AskWatchFolder();
 	bool CreateGui();
 	QToolBar* CreateMediaActionsToolBar();
 	QToolBar* CreatePlaylistActionsToolBar();
@@ -120,7 +125,8 @@ private:
 	gui::Playlist* GetPlaylistById(const i64 playlist_id, int *pindex = nullptr) const;
 	void InitTrayIcon();
 	bool SongAndPlaylistMatch(const audio::TempSongInfo &tsi) const;
-	bool LoadPlaylist(const QString &full_path);
+	bool LoadLegacyPlaylist(const QString &full_path);
+	bool LoadPlaylist(const QString &full_path, gui::Playlist **active);
 	void LoadPlaylists();
 	int PickSong(QVector<Song*> *vec, const int current_song_index,
 		const audio::Pick pick);
@@ -132,15 +138,18 @@ private:
 	void RegisterGlobalShortcuts();
 	void RegisterWindowShortcuts();
 	bool SavePlaylist(gui::Playlist *playlist, const QString &dir_path, const bool is_active);
-	bool SavePlaylistSimple(gui::Playlist *playlist);
 	void SavePlaylistState(const i64 id);
 	void SelectAllSongsInVisiblePlaylist();
+	void StopWatchingFolders();
 	
 	NO_ASSIGN_COPY_MOVE(App);
 	
 	gui::SeekPane *seek_pane_ = nullptr;
 	GstPlayer *player_ = nullptr;
-	DiscovererUserParams user_params_ = {nullptr, nullptr, nullptr};
+	DiscovererPool *discoverers_ = nullptr;
+	Importer *importer_ = nullptr;
+	PlaylistLoader *loader_ = nullptr;
+	Saver *saver_ = nullptr;
 	QAction *play_pause_action_ = nullptr;
 	audio::PlayMode play_mode_ = audio::PlayMode::None;
 	QComboBox *playlists_cb_ = nullptr;
@@ -27,6 +27,8 @@ public:
 	void add_f64(const double n);
 	void add_string(const QString &s);
 	
+	usize at() const { return at_; }
+	void clear() { at_ = size_ = 0; }
 	char *data() { return data_; }
 	
 	void next(char *p, const usize sz);
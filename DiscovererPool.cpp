@@ -0,0 +1,267 @@
+#include "DiscovererPool.hpp"
+
+#include "App.hpp"
+#include "gui/Playlist.hpp"
+#include "gui/TableModel.hpp"
+#include "Importer.hpp"
+#include "Song.hpp"
+
+#include <algorithm>
+
+namespace quince {
+
+DiscovererPool::DiscovererPool(App *app, const int max_workers,
+	const GstClockTime timeout) :
+app_(app),
+max_workers_(max_workers),
+timeout_(timeout)
+{}
+
+DiscovererPool::~DiscovererPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		stop_ = true;
+	}
+	
+	jobs_cv_.notify_all();
+	
+	// A file being probed right now is given up to the timeout
+	for (std::thread &t: workers_)
+		t.join();
+}
+
+void
+DiscovererPool::Add(const QVector<Song*> &songs)
+{
+	if (songs.isEmpty())
+		return;
+	
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		
+		for (Song *song: songs)
+		{
+			if (pending_uris_.contains(song))
+				continue;
+			
+			const QByteArray uri = song->uri().toLocal8Bit();
+			auto it = pending_.find(uri);
+			
+			if (it == pending_.end())
+			{
+				discover::Job job;
+				job.ticket = next_ticket_++;
+				job.uri = uri;
+				jobs_.push_back(job);
+				
+				discover::Pending pending;
+				pending.ticket = job.ticket;
+				it = pending_.insert(uri, pending);
+			}
+			
+			it.value().targets.append(discover::Target {song->playlist_id(), song});
+			pending_uris_.insert(song, uri);
+		}
+		
+		const usize wanted = std::min(jobs_.size(), usize(max_workers_));
+		
+		while (workers_.size() < wanted)
+			workers_.emplace_back(&DiscovererPool::Loop, this);
+	}
+	
+	jobs_cv_.notify_all();
+}
+
+void
+DiscovererPool::Cancel(Song *song)
+{
+	auto uri_it = pending_uris_.find(song);
+	
+	if (uri_it == pending_uris_.end())
+		return;
+	
+	auto it = pending_.find(uri_it.value());
+	pending_uris_.erase(uri_it);
+	
+	if (it == pending_.end())
+		return;
+	
+	QVector<discover::Target> &targets = it.value().targets;
+	
+	for (int i = 0; i < targets.size(); i++)
+	{
+		if (targets[i].song == song) {
+			targets.remove(i);
+			break;
+		}
+	}
+	
+	if (!targets.isEmpty())
+		return;
+	
+	// The worker skips the job if it didn't get to it yet,
+	// otherwise its result gets dropped on delivery.
+	std::lock_guard<std::mutex> guard(mutex_);
+	cancelled_.insert(it.value().ticket);
+	pending_.erase(it);
+}
+
+void
+DiscovererPool::DeliverResults()
+{
+	std::vector<discover::Result> results;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		results.swap(results_);
+		results_scheduled_ = false;
+		
+		for (const discover::Result &result: results)
+			cancelled_.erase(result.ticket);
+	}
+	
+	for (discover::Result &result: results)
+	{
+		auto it = pending_.find(result.uri);
+		
+		// All of its songs got removed in the meantime
+		if (it == pending_.end() || it.value().ticket != result.ticket)
+			continue;
+		
+		const QVector<discover::Target> targets = it.value().targets;
+		pending_.erase(it);
+		
+		for (const discover::Target &target: targets)
+		{
+			pending_uris_.remove(target.song);
+			
+			if (!result.ok)
+				continue;
+			
+			target.song->Apply(result.info);
+			gui::Playlist *playlist = app_->PickPlaylist(target.playlist_id);
+			
+			if (playlist != nullptr)
+				playlist->table_model()->Changed(target.song);
+		}
+		
+		if (result.ok && !targets.isEmpty())
+			app_->importer()->StoreMeta(targets[0].song);
+	}
+}
+
+void
+DiscovererPool::Loop()
+{
+	// Keeps the discoverer's sources off the default main context,
+	// which is the one the Qt event loop dispatches.
+	GMainContext *context = g_main_context_new();
+	g_main_context_push_thread_default(context);
+	
+	GError *err = nullptr;
+	GstDiscoverer *discoverer = gst_discoverer_new(timeout_, &err);
+	
+	if (discoverer == nullptr) {
+		mtl_warn("Error creating discoverer instance: %s", err->message);
+		g_clear_error(&err);
+	}
+	
+	while (discoverer != nullptr)
+	{
+		discover::Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			jobs_cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+			
+			if (stop_)
+				break;
+			
+			job = jobs_.front();
+			jobs_.pop_front();
+			
+			if (cancelled_.erase(job.ticket) > 0)
+				continue;
+		}
+		
+		discover::Result result;
+		result.ticket = job.ticket;
+		result.uri = job.uri;
+		result.ok = Run(discoverer, job, result.info);
+		
+		bool schedule = false;
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			results_.push_back(result);
+			
+			if (!results_scheduled_) {
+				results_scheduled_ = true;
+				schedule = true;
+			}
+		}
+		
+		if (schedule) {
+			QMetaObject::invokeMethod(app_, [this] {
+				DeliverResults();
+			}, Qt::QueuedConnection);
+		}
+	}
+	
+	if (discoverer != nullptr)
+		g_object_unref(discoverer);
+	
+	g_main_context_pop_thread_default(context);
+	g_main_context_unref(context);
+}
+
+bool
+DiscovererPool::Run(GstDiscoverer *discoverer, const discover::Job &job,
+	audio::Info &audio_info)
+{
+	GError *err = nullptr;
+	GstDiscovererInfo *info = gst_discoverer_discover_uri(discoverer,
+		job.uri.data(), &err);
+	
+	if (info == nullptr) {
+		mtl_warn("Discoverer error: %s, uri: \"%s\"",
+			(err ? err->message : ""), job.uri.data());
+		g_clear_error(&err);
+		return false;
+	}
+	
+	g_clear_error(&err);
+	GstDiscovererResult result = gst_discoverer_info_get_result(info);
+	
+	if (result == GST_DISCOVERER_MISSING_PLUGINS) {
+		const GstStructure *s = gst_discoverer_info_get_misc(info);
+		gchar *str = gst_structure_to_string(s);
+		mtl_warn("Missing plugins: %s", str);
+		g_free(str);
+	}
+	
+	if (result != GST_DISCOVERER_OK) {
+		mtl_trace("This URI cannot be played: %d, uri: \"%s\"",
+			result, job.uri.data());
+		gst_discoverer_info_unref(info);
+		return false;
+	}
+	
+	audio_info.duration = gst_discoverer_info_get_duration(info);
+	audio_info.uri = job.uri;
+	
+	GList *audio_streams = gst_discoverer_info_get_audio_streams(info);
+	
+	for (auto *l = audio_streams; l != NULL; l = l->next)
+	{
+		auto *discov_audio_info = (GstDiscovererAudioInfo*)l->data;
+		audio_info.bitrate = gst_discoverer_audio_info_get_bitrate(discov_audio_info);
+		audio_info.channels =  gst_discoverer_audio_info_get_channels(discov_audio_info);
+		audio_info.sample_rate = gst_discoverer_audio_info_get_sample_rate(discov_audio_info);
+	}
+	
+	gst_discoverer_stream_info_list_free(audio_streams);
+	gst_discoverer_info_unref(info);
+	
+	return true;
+}
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "audio.hxx"
+#include "decl.hxx"
+#include "err.hpp"
+#include "types.hxx"
+
+#include <gst/gst.h>
+#include <gst/pbutils/pbutils.h>
+
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace quince {
+
+namespace discover {
+
+struct Job {
+	u64 ticket = 0;
+	QByteArray uri;
+};
+
+struct Result {
+	u64 ticket = 0;
+	QByteArray uri;
+	audio::Info info = {};
+	bool ok = false;
+};
+
+// A song waiting for its file to be probed, found again by its
+// playlist and handle rather than by row since rows move meanwhile.
+struct Target {
+	i64 playlist_id = -1;
+	Song *song = nullptr;
+};
+
+// All the songs of one file (it can be in several playlists),
+// the file is probed once for all of them.
+struct Pending {
+	u64 ticket = 0;
+	QVector<Target> targets;
+};
+
+}
+
+/* Probes the songs no native reader could fully handle with GStreamer.
+ Each worker thread owns a GstDiscoverer (on its own GMainContext) and
+ probes one file at a time, so at most max_workers files are probed at
+ once and a file that hangs only holds up its own worker until the
+ per-file timeout. The workers are started as needed, the results are
+ applied on the GUI thread in batches. */
+class DiscovererPool {
+public:
+	DiscovererPool(App *app, const int max_workers, const GstClockTime timeout);
+	virtual ~DiscovererPool();
+	
+	void Add(const QVector<Song*> &songs);
+	void Cancel(Song *song);
+	bool is_pending(Song *song) const { return pending_uris_.contains(song); }
+
+private:
+	NO_ASSIGN_COPY_MOVE(DiscovererPool);
+	
+	void DeliverResults();
+	void Loop();
+	static bool Run(GstDiscoverer *discoverer, const discover::Job &job,
+		audio::Info &audio_info);
+	
+	App *app_ = nullptr;
+	const int max_workers_;
+	const GstClockTime timeout_;
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable jobs_cv_;
+	std::deque<discover::Job> jobs_;
+	std::unordered_set<u64> cancelled_;
+	std::vector<discover::Result> results_;
+	bool results_scheduled_ = false;
+	bool stop_ = false;
+	
+	// GUI thread only:
+	QHash<QByteArray, discover::Pending> pending_; // by URI
+	QHash<Song*, QByteArray> pending_uris_;
+	u64 next_ticket_ = 1;
+};
+
+}
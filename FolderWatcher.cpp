@@ -0,0 +1,941 @@
+#include "FolderWatcher.hpp"
+
+#include "App.hpp"
+#include "ByteArray.hpp"
+#include "io/io.hh"
+
+#include <QFileInfo>
+#include <QSet>
+
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iterator>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace quince {
+
+static const u32 WatchStateMagic = 0x57504C51; // "QPLW"
+static const i32 WatchStateVersion = 1;
+static const int SaveDelayMs = 30 * 1000; // after the last change
+static const usize EventBufferSize = 64 * 1024;
+
+// New files are picked up when they're closed after being written rather
+// than when they're created, a file being ripped or copied isn't complete
+// before that. Symlinked folders aren't followed.
+static const u32 WatchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+	IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+	IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+static i64
+MtimeOf(const struct stat &st)
+{
+	return i64(st.st_mtim.tv_sec) * 1000000000L + st.st_mtim.tv_nsec;
+}
+
+static void
+AddBytes(ByteArray &ba, const QByteArray &s)
+{
+	ba.add_i32(s.size());
+	ba.add(s.constData(), s.size());
+}
+
+// "total" is the file's size, next_*() grows ba.size()
+static bool
+NextBytes(ByteArray &ba, const usize total, QByteArray &s)
+{
+	if (ba.at() + sizeof(i32) > total)
+		return false;
+	
+	const i32 len = ba.next_i32();
+	
+	if (len < 0 || ba.at() + len > total)
+		return false;
+	
+	s = QByteArray(ba.data() + ba.at(), len);
+	ba.to(ba.at() + len);
+	
+	return true;
+}
+
+static void
+AddNames(ByteArray &ba, const std::vector<QByteArray> &names)
+{
+	ba.add_i32(names.size());
+	
+	for (const QByteArray &name: names)
+		AddBytes(ba, name);
+}
+
+static bool
+NextNames(ByteArray &ba, const usize total, std::vector<QByteArray> &names)
+{
+	if (ba.at() + sizeof(i32) > total)
+		return false;
+	
+	const i32 count = ba.next_i32();
+	
+	for (i32 i = 0; i < count; i++)
+	{
+		QByteArray name;
+		
+		if (!NextBytes(ba, total, name))
+			return false;
+		
+		names.push_back(name);
+	}
+	
+	return count >= 0;
+}
+
+static bool
+SplitPath(const QByteArray &path, QByteArray &dir_path, QByteArray &name)
+{
+	const int slash = path.lastIndexOf('/');
+	
+	if (slash == -1)
+		return false;
+	
+	dir_path = path.left(slash);
+	name = path.mid(slash + 1);
+	
+	return true;
+}
+
+// Both return false if there was nothing to do
+static bool
+InsertSorted(std::vector<QByteArray> &vec, const QByteArray &s)
+{
+	auto it = std::lower_bound(vec.begin(), vec.end(), s);
+	
+	if (it != vec.end() && *it == s)
+		return false;
+	
+	vec.insert(it, s);
+	
+	return true;
+}
+
+static bool
+EraseSorted(std::vector<QByteArray> &vec, const QByteArray &s)
+{
+	auto it = std::lower_bound(vec.begin(), vec.end(), s);
+	
+	if (it == vec.end() || *it != s)
+		return false;
+	
+	vec.erase(it);
+	
+	return true;
+}
+
+static bool
+IsUnder(const QByteArray &path, const QByteArray &dir_path)
+{
+	return path.size() > dir_path.size() && path.startsWith(dir_path) &&
+		path[dir_path.size()] == '/';
+}
+
+static void
+Wake(const int fd)
+{
+	const u64 one = 1;
+	
+	if (write(fd, &one, sizeof one) == -1)
+		mtl_warn("%s", strerror(errno));
+}
+
+FolderWatcher::FolderWatcher(App *app, const i64 playlist_id,
+	const QString &state_path, const int max_depth) :
+app_(app),
+playlist_id_(playlist_id),
+state_path_(state_path),
+max_depth_(max_depth)
+{}
+
+FolderWatcher::~FolderWatcher()
+{
+	if (thread_.joinable())
+	{
+		stop_ = true;
+		Wake(wake_fd_);
+		thread_.join();
+	}
+	
+	if (inotify_fd_ != -1)
+		close(inotify_fd_);
+	
+	if (wake_fd_ != -1)
+		close(wake_fd_);
+}
+
+void
+FolderWatcher::AddRoot(const QString &dir_path)
+{
+	// Resolved since symlinked folders aren't followed
+	const QString canonical_path = QFileInfo(dir_path).canonicalFilePath();
+	
+	if (canonical_path.isEmpty())
+		return;
+	
+	const QByteArray path = canonical_path.toLocal8Bit();
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		new_roots_.push_back(path);
+	}
+	
+	if (wake_fd_ != -1)
+		Wake(wake_fd_);
+}
+
+void
+FolderWatcher::AddWatch(const QByteArray &path, watch::Dir &dir)
+{
+	const int wd = inotify_add_watch(inotify_fd_, path.constData(), WatchMask);
+	
+	if (wd == -1)
+	{
+		if (errno == ENOSPC && !out_of_watches_) {
+			out_of_watches_ = true;
+			mtl_warn("Out of inotify watches, see /proc/sys/fs/inotify/max_user_watches");
+		}
+		return;
+	}
+	
+	dir.wd = wd;
+	wd_paths_.insert(wd, path);
+}
+
+void
+FolderWatcher::Appeared(const QByteArray &path, const bool is_dir)
+{
+	QByteArray dir_path, name;
+	
+	if (!SplitPath(path, dir_path, name))
+		return;
+	
+	auto it = dirs_.find(dir_path);
+	
+	if (it == dirs_.end())
+		return;
+	
+	modified_ = true;
+	
+	if (is_dir)
+	{
+		InsertSorted(it->subdirs, name);
+		
+		if (dirs_.contains(path))
+			Sync(path, Depth(path));
+		else
+			Scan(path, Depth(path));
+	} else if (io::IsSongFileName(name.constData(), name.size()) &&
+		InsertSorted(it->files, name)) {
+		EmitAdded(path);
+	}
+}
+
+void
+FolderWatcher::Deliver()
+{
+	if (events_.empty())
+		return;
+	
+	std::vector<watch::Event> events;
+	events.swap(events_);
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		unsaved_deliveries_++;
+	}
+	
+	App *app = app_;
+	const i64 playlist_id = playlist_id_;
+	
+	// Doesn't refer to the watcher, it goes away with its playlist
+	QMetaObject::invokeMethod(app_, [app, playlist_id, events] () mutable {
+		app->WatchedFoldersChanged(playlist_id, events);
+	}, Qt::QueuedConnection);
+}
+
+int
+FolderWatcher::Depth(const QByteArray &path) const
+{
+	for (const QByteArray &root: roots_)
+	{
+		if (IsUnder(path, root))
+			return path.mid(root.size()).count('/');
+	}
+	
+	return 0;
+}
+
+void
+FolderWatcher::Disappeared(const QByteArray &path, const bool is_dir)
+{
+	QByteArray dir_path, name;
+	
+	if (!SplitPath(path, dir_path, name))
+		return;
+	
+	auto it = dirs_.find(dir_path);
+	modified_ = true;
+	
+	if (is_dir)
+	{
+		if (it != dirs_.end())
+			EraseSorted(it->subdirs, name);
+		
+		RemoveDir(path);
+	} else if (it != dirs_.end() && EraseSorted(it->files, name)) {
+		Emit(watch::EventType::Removed, path);
+	}
+}
+
+void
+FolderWatcher::Emit(const watch::EventType type, const QByteArray &path,
+	const QByteArray &new_path)
+{
+	watch::Event event;
+	event.type = type;
+	event.path = path;
+	event.new_path = new_path;
+	events_.push_back(event);
+}
+
+void
+FolderWatcher::EmitAdded(const QByteArray &path)
+{
+	struct stat st;
+	QByteArray dir_path, name;
+	
+	if (!SplitPath(path, dir_path, name) || stat(path.constData(), &st) != 0 ||
+		!S_ISREG(st.st_mode))
+		return;
+	
+	watch::Event event;
+	event.type = watch::EventType::Added;
+	event.path = path;
+	io::FillIn(event.file, st, QString::fromLocal8Bit(dir_path),
+		QString::fromLocal8Bit(name));
+	events_.push_back(event);
+}
+
+bool
+FolderWatcher::IsRoot(const QByteArray &path) const
+{
+	return std::find(roots_.begin(), roots_.end(), path) != roots_.end();
+}
+
+bool
+FolderWatcher::List(const QByteArray &path, watch::Dir &dir)
+{
+	const int fd = open(path.constData(),
+		O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	
+	if (fd == -1)
+		return false;
+	
+	struct stat st;
+	
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+	
+	DIR *dp = fdopendir(fd);
+	
+	if (dp == nullptr) {
+		close(fd);
+		return false;
+	}
+	
+	// Taken before listing, a change made meanwhile shows up next time
+	dir.mtime = MtimeOf(st);
+	dir.files.clear();
+	dir.subdirs.clear();
+	const int dir_fd = dirfd(dp);
+	struct dirent *entry;
+	
+	while ((entry = readdir(dp)) != nullptr)
+	{
+		const char *name = entry->d_name;
+		
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+			continue;
+		
+		const usize name_len = strlen(name);
+		unsigned char type = entry->d_type;
+		
+		if (type == DT_UNKNOWN)
+		{
+			if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+				continue;
+			
+			if (S_ISDIR(st.st_mode))
+				type = DT_DIR;
+			else if (S_ISREG(st.st_mode))
+				type = DT_REG;
+			else if (S_ISLNK(st.st_mode))
+				type = DT_LNK;
+		}
+		
+		if (type == DT_DIR) {
+			dir.subdirs.push_back(QByteArray(name, name_len));
+		} else if ((type == DT_REG || type == DT_LNK) &&
+			io::IsSongFileName(name, name_len)) {
+			dir.files.push_back(QByteArray(name, name_len));
+		}
+	}
+	
+	closedir(dp);
+	std::sort(dir.files.begin(), dir.files.end());
+	std::sort(dir.subdirs.begin(), dir.subdirs.end());
+	
+	return true;
+}
+
+bool
+FolderWatcher::LoadState()
+{
+	auto path_ba = state_path_.toLocal8Bit();
+	
+	if (!io::FileExists(path_ba.data()))
+		return true; // a new watch
+	
+	ByteArray ba;
+	
+	if (io::ReadFile(state_path_, ba) != io::Err::Ok) {
+		mtl_trace("Couldn't read file: %s", path_ba.data());
+		return false;
+	}
+	
+	const usize total = ba.size();
+	
+	if (total < sizeof(u32) + sizeof(i32) * 2 ||
+		ba.next_u32() != WatchStateMagic || ba.next_i32() != WatchStateVersion)
+		return false;
+	
+	const i32 root_count = ba.next_i32();
+	
+	for (i32 i = 0; i < root_count; i++)
+	{
+		QByteArray root;
+		
+		if (!NextBytes(ba, total, root))
+			return false;
+		
+		roots_.push_back(root);
+	}
+	
+	if (ba.at() + sizeof(i32) > total)
+		return true;
+	
+	const i32 dir_count = ba.next_i32();
+	
+	// A truncated file only costs listing the folders missing from it
+	for (i32 i = 0; i < dir_count; i++)
+	{
+		QByteArray path;
+		watch::Dir dir;
+		
+		if (!NextBytes(ba, total, path) || ba.at() + sizeof(i64) > total)
+			break;
+		
+		dir.mtime = ba.next_i64();
+		
+		if (!NextNames(ba, total, dir.files) ||
+			!NextNames(ba, total, dir.subdirs))
+			break;
+		
+		dirs_.insert(path, dir);
+	}
+	
+	return true;
+}
+
+void
+FolderWatcher::Loop()
+{
+	LoadState();
+	
+	// Catch up with what changed while the app was closed
+	const std::vector<QByteArray> roots = roots_;
+	
+	for (const QByteArray &root: roots)
+		Sync(root, 0);
+	
+	Deliver();
+	TakeNewRoots();
+	
+	if (modified_ && SaveAllowed())
+		SaveState();
+	
+	struct pollfd fds[2] = {
+		{ .fd = inotify_fd_, .events = POLLIN, .revents = 0 },
+		{ .fd = wake_fd_, .events = POLLIN, .revents = 0 }
+	};
+	
+	while (true)
+	{ // no timeout unless there's a change to save
+		const int n = poll(fds, 2, modified_ ? SaveDelayMs : -1);
+		
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			
+			mtl_warn("%s", strerror(errno));
+			break;
+		}
+		
+		if (n == 0) {
+			if (SaveAllowed())
+				SaveState();
+			continue;
+		}
+		
+		if (fds[1].revents & POLLIN)
+		{
+			u64 count;
+			
+			if (read(wake_fd_, &count, sizeof count) == -1)
+				mtl_warn("%s", strerror(errno));
+			
+			if (stop_)
+				break;
+			
+			TakeNewRoots();
+			
+			if (roots_unsaved_ && SaveAllowed())
+				SaveState();
+		}
+		
+		if (fds[0].revents & POLLIN)
+			ReadEvents();
+		
+		Deliver();
+	}
+	
+	// Else the folders get listed again on the next start. Not with
+	// events left undelivered, stopped while listing a folder tree.
+	if (modified_ && events_.empty() && SaveAllowed())
+		SaveState();
+}
+
+void
+FolderWatcher::Move(const QByteArray &from, const QByteArray &to,
+	const bool is_dir)
+{
+	QByteArray from_dir, from_name, to_dir, to_name;
+	
+	if (!SplitPath(from, from_dir, from_name) || !SplitPath(to, to_dir, to_name))
+		return;
+	
+	auto from_it = dirs_.find(from_dir);
+	auto to_it = dirs_.find(to_dir);
+	modified_ = true;
+	
+	if (!is_dir)
+	{
+		const bool had = from_it != dirs_.end() &&
+			EraseSorted(from_it->files, from_name);
+		const bool has = to_it != dirs_.end() &&
+			io::IsSongFileName(to_name.constData(), to_name.size()) &&
+			InsertSorted(to_it->files, to_name);
+		
+		if (had && has)
+			Emit(watch::EventType::Moved, from, to);
+		else if (had)
+			Emit(watch::EventType::Removed, from);
+		else if (has)
+			EmitAdded(to);
+		
+		return;
+	}
+	
+	if (from_it != dirs_.end())
+		EraseSorted(from_it->subdirs, from_name);
+	
+	if (to_it != dirs_.end())
+		InsertSorted(to_it->subdirs, to_name);
+	
+	if (!dirs_.contains(from)) {
+		Scan(to, Depth(to));
+		return;
+	}
+	
+	// The watches stay with the folders, only their paths change
+	std::vector<std::pair<QByteArray, watch::Dir>> moved;
+	
+	for (auto it = dirs_.begin(); it != dirs_.end();)
+	{
+		if (it.key() == from || IsUnder(it.key(), from)) {
+			moved.push_back({to + it.key().mid(from.size()), it.value()});
+			it = dirs_.erase(it);
+		} else {
+			it++;
+		}
+	}
+	
+	for (const auto &item: moved)
+	{
+		dirs_.insert(item.first, item.second);
+		
+		if (item.second.wd != -1)
+			wd_paths_.insert(item.second.wd, item.first);
+	}
+	
+	Emit(watch::EventType::DirMoved, from, to);
+}
+
+void
+FolderWatcher::Persisted()
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+	
+	if (unsaved_deliveries_ > 0)
+		unsaved_deliveries_--;
+	
+	// Lets the thread save new roots right away, see TakeNewRoots()
+	if (unsaved_deliveries_ == 0 && wake_fd_ != -1)
+		Wake(wake_fd_);
+}
+
+void
+FolderWatcher::ReadEvents()
+{
+	struct MovedFrom {
+		u32 cookie;
+		QByteArray path;
+		bool is_dir;
+	};
+	
+	std::vector<MovedFrom> moved_from;
+	QSet<QByteArray> touched;
+	bool overflow = false;
+	alignas(struct inotify_event) char buf[EventBufferSize];
+	
+	while (true)
+	{ // until EAGAIN, which keeps the two halves of a move together
+		const ssize_t len = read(inotify_fd_, buf, sizeof buf);
+		
+		if (len <= 0)
+			break;
+		
+		for (char *p = buf; p < buf + len;)
+		{
+			const auto *ev = reinterpret_cast<const struct inotify_event*>(p);
+			p += sizeof(struct inotify_event) + ev->len;
+			
+			if (ev->mask & IN_Q_OVERFLOW) {
+				overflow = true;
+				continue;
+			}
+			
+			auto wd_it = wd_paths_.find(ev->wd);
+			
+			if (wd_it == wd_paths_.end())
+				continue;
+			
+			if (ev->mask & IN_IGNORED) {
+				wd_paths_.erase(wd_it);
+				continue;
+			}
+			
+			const QByteArray dir_path = wd_it.value();
+			
+			if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+			{ // other folders are taken care of through their parent's events
+				if (IsRoot(dir_path))
+					RemoveDir(dir_path);
+				continue;
+			}
+			
+			if (ev->len == 0)
+				continue;
+			
+			const QByteArray path = dir_path + '/' + QByteArray(ev->name);
+			const bool is_dir = ev->mask & IN_ISDIR;
+			touched.insert(dir_path);
+			
+			if (ev->mask & IN_MOVED_FROM)
+			{
+				moved_from.push_back(MovedFrom {ev->cookie, path, is_dir});
+			} else if (ev->mask & IN_MOVED_TO) {
+				auto it = std::find_if(moved_from.begin(), moved_from.end(),
+				[ev] (const MovedFrom &item) { return item.cookie == ev->cookie; });
+				
+				if (it != moved_from.end()) {
+					Move(it->path, path, is_dir);
+					moved_from.erase(it);
+				} else { // from outside of the watched folders
+					Appeared(path, is_dir);
+				}
+			} else if (ev->mask & IN_DELETE) {
+				Disappeared(path, is_dir);
+			} else if (ev->mask & IN_CLOSE_WRITE) {
+				Appeared(path, false);
+			} else if ((ev->mask & IN_CREATE) && is_dir) {
+				Appeared(path, true);
+			}
+		}
+	}
+	
+	// Moved out of the watched folders
+	for (const MovedFrom &item: moved_from)
+		Disappeared(item.path, item.is_dir);
+	
+	if (overflow)
+	{ // events got lost, every folder is listed again
+		for (watch::Dir &dir: dirs_)
+			dir.mtime = -1;
+		
+		const std::vector<QByteArray> roots = roots_;
+		
+		for (const QByteArray &root: roots)
+			Sync(root, 0);
+		
+		return;
+	}
+	
+	struct stat st;
+	
+	for (const QByteArray &dir_path: touched)
+	{
+		auto it = dirs_.find(dir_path);
+		
+		if (it != dirs_.end() && stat(dir_path.constData(), &st) == 0)
+			it->mtime = MtimeOf(st);
+	}
+}
+
+void
+FolderWatcher::RemoveDir(const QByteArray &path)
+{
+	bool found = false;
+	
+	for (auto it = dirs_.begin(); it != dirs_.end();)
+	{
+		if (it.key() != path && !IsUnder(it.key(), path)) {
+			it++;
+			continue;
+		}
+		
+		if (it->wd != -1) {
+			inotify_rm_watch(inotify_fd_, it->wd);
+			wd_paths_.remove(it->wd);
+		}
+		
+		it = dirs_.erase(it);
+		found = true;
+	}
+	
+	if (found) {
+		Emit(watch::EventType::DirRemoved, path);
+		modified_ = true;
+	}
+}
+
+bool
+FolderWatcher::SaveAllowed()
+{ // not while the playlist has yet to save what was delivered
+	std::lock_guard<std::mutex> guard(mutex_);
+	
+	return unsaved_deliveries_ == 0;
+}
+
+bool
+FolderWatcher::SaveState()
+{
+	ByteArray ba;
+	ba.add_u32(WatchStateMagic);
+	ba.add_i32(WatchStateVersion);
+	ba.add_i32(roots_.size());
+	
+	for (const QByteArray &root: roots_)
+		AddBytes(ba, root);
+	
+	ba.add_i32(dirs_.size());
+	
+	for (auto it = dirs_.cbegin(); it != dirs_.cend(); it++)
+	{
+		AddBytes(ba, it.key());
+		ba.add_i64(it->mtime);
+		AddNames(ba, it->files);
+		AddNames(ba, it->subdirs);
+	}
+	
+	modified_ = false;
+	roots_unsaved_ = false;
+	
+	if (io::ReplaceFile(state_path_, ba.data(), ba.size()) != io::Err::Ok) {
+		auto path_ba = state_path_.toLocal8Bit();
+		mtl_warn("Failed to save %s", path_ba.data());
+		return false;
+	}
+	
+	return true;
+}
+
+void
+FolderWatcher::Scan(const QByteArray &path, const int depth)
+{
+	if (depth >= max_depth_ || stop_)
+		return;
+	
+	watch::Dir dir;
+	
+	// Watched before being listed so that nothing added meanwhile is missed
+	AddWatch(path, dir);
+	
+	if (!List(path, dir))
+	{
+		if (dir.wd != -1) {
+			inotify_rm_watch(inotify_fd_, dir.wd);
+			wd_paths_.remove(dir.wd);
+		}
+		return;
+	}
+	
+	for (const QByteArray &name: dir.files)
+		EmitAdded(path + '/' + name);
+	
+	const std::vector<QByteArray> subdirs = dir.subdirs;
+	dirs_.insert(path, dir);
+	modified_ = true;
+	
+	for (const QByteArray &name: subdirs)
+		Scan(path + '/' + name, depth + 1);
+}
+
+void
+FolderWatcher::Start()
+{
+	if (thread_.joinable() || inotify_fd_ != -1)
+		return;
+	
+	inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	
+	if (inotify_fd_ == -1 || wake_fd_ == -1) {
+		mtl_warn("%s", strerror(errno));
+		return;
+	}
+	
+	thread_ = std::thread(&FolderWatcher::Loop, this);
+}
+
+void
+FolderWatcher::Sync(const QByteArray &path, const int depth)
+{
+	if (stop_)
+		return; // what's left gets listed on the next start
+	
+	auto it = dirs_.find(path);
+	
+	if (it == dirs_.end()) {
+		Scan(path, depth);
+		return;
+	}
+	
+	struct stat st;
+	
+	if (depth >= max_depth_ || lstat(path.constData(), &st) != 0 ||
+		!S_ISDIR(st.st_mode)) {
+		RemoveDir(path);
+		return;
+	}
+	
+	AddWatch(path, it.value());
+	
+	if (MtimeOf(st) == it->mtime)
+	{
+		const std::vector<QByteArray> subdirs = it->subdirs;
+		
+		for (const QByteArray &name: subdirs)
+			Sync(path + '/' + name, depth + 1);
+		
+		return;
+	}
+	
+	// Something was added, removed or renamed in it
+	watch::Dir now;
+	now.wd = it->wd;
+	
+	if (!List(path, now))
+		return;
+	
+	watch::Dir was;
+	std::swap(was, it.value());
+	it.value() = now;
+	modified_ = true;
+	
+	std::vector<QByteArray> gone, came, kept;
+	std::set_difference(was.files.begin(), was.files.end(),
+		now.files.begin(), now.files.end(), std::back_inserter(gone));
+	std::set_difference(now.files.begin(), now.files.end(),
+		was.files.begin(), was.files.end(), std::back_inserter(came));
+	
+	for (const QByteArray &name: gone)
+		Emit(watch::EventType::Removed, path + '/' + name);
+	
+	for (const QByteArray &name: came)
+		EmitAdded(path + '/' + name);
+	
+	gone.clear();
+	came.clear();
+	std::set_difference(was.subdirs.begin(), was.subdirs.end(),
+		now.subdirs.begin(), now.subdirs.end(), std::back_inserter(gone));
+	std::set_difference(now.subdirs.begin(), now.subdirs.end(),
+		was.subdirs.begin(), was.subdirs.end(), std::back_inserter(came));
+	std::set_intersection(now.subdirs.begin(), now.subdirs.end(),
+		was.subdirs.begin(), was.subdirs.end(), std::back_inserter(kept));
+	
+	for (const QByteArray &name: gone)
+		RemoveDir(path + '/' + name);
+	
+	for (const QByteArray &name: came)
+		Scan(path + '/' + name, depth + 1);
+	
+	for (const QByteArray &name: kept)
+		Sync(path + '/' + name, depth + 1);
+}
+
+void
+FolderWatcher::TakeNewRoots()
+{
+	std::deque<QByteArray> new_roots;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		new_roots.swap(new_roots_);
+	}
+	
+	if (new_roots.empty())
+		return;
+	
+	for (const QByteArray &path: new_roots)
+	{
+		if (IsRoot(path))
+			continue;
+		
+		roots_.push_back(path);
+		Sync(path, 0);
+		Deliver();
+	}
+	
+	// Right away, the new folders shouldn't depend on a clean exit. But
+	// not ahead of the playlist saving their files, else after a crash
+	// they'd be taken as added already. Persisted() wakes the thread up
+	// to save once it did.
+	roots_unsaved_ = true;
+	
+	if (SaveAllowed())
+		SaveState();
+}
+
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "decl.hxx"
+#include "err.hpp"
+#include "io/File.hpp"
+#include "types.hxx"
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace quince {
+
+namespace watch {
+
+enum class EventType : u8 {
+	Added, // a song file showed up, see "file"
+	Removed, // "path" is gone
+	Moved, // "path" is now "new_path"
+	DirRemoved, // the folder "path" and everything in it is gone
+	DirMoved // the folder "path" is now "new_path"
+};
+
+struct Event {
+	EventType type = EventType::Added;
+	io::File file;
+	QByteArray path;
+	QByteArray new_path;
+};
+
+// What was seen in a watched folder the last time it was listed
+struct Dir {
+	i64 mtime = -1; // nanoseconds
+	int wd = -1; // inotify watch descriptor
+	std::vector<QByteArray> files; // song file names, sorted
+	std::vector<QByteArray> subdirs; // sorted
+};
+
+}
+
+/* Keeps a playlist in sync with the folder trees it watches. A thread
+ watches every folder of the trees through inotify and turns the files
+ being created, deleted and moved into events that the GUI thread
+ applies to the playlist as inserts, removes and path updates.
+ What was seen (the song files and the mtime of each folder) is kept in
+ a state file next to the playlist, so after a restart only the folders
+ whose mtime changed while the app was closed get listed again. */
+class FolderWatcher {
+public:
+	FolderWatcher(App *app, const i64 playlist_id, const QString &state_path,
+		const int max_depth);
+	virtual ~FolderWatcher(); // saves the state
+	
+	void
+	AddRoot(const QString &dir_path);
+	
+	static QString
+	PathFor(const QString &playlist_path) {
+		return playlist_path + QLatin1String(".watch");
+	}
+	
+	// The playlist saved the edits of one delivery of events
+	void
+	Persisted();
+	
+	// Watching starts once the playlist's songs are loaded
+	void
+	Start();
+
+private:
+	NO_ASSIGN_COPY_MOVE(FolderWatcher);
+	
+	void AddWatch(const QByteArray &path, watch::Dir &dir);
+	void Appeared(const QByteArray &path, const bool is_dir);
+	void Deliver();
+	int Depth(const QByteArray &path) const;
+	void Disappeared(const QByteArray &path, const bool is_dir);
+	void Emit(const watch::EventType type, const QByteArray &path,
+		const QByteArray &new_path = QByteArray());
+	void EmitAdded(const QByteArray &path);
+	bool IsRoot(const QByteArray &path) const;
+	bool List(const QByteArray &path, watch::Dir &dir);
+	bool LoadState();
+	void Loop();
+	void Move(const QByteArray &from, const QByteArray &to, const bool is_dir);
+	void ReadEvents();
+	void RemoveDir(const QByteArray &path);
+	bool SaveAllowed();
+	bool SaveState();
+	void Scan(const QByteArray &path, const int depth);
+	void Sync(const QByteArray &path, const int depth);
+	void TakeNewRoots();
+	
+	App *app_ = nullptr;
+	const i64 playlist_id_;
+	const QString state_path_;
+	const int max_depth_; // folder levels watched, 1 = no subfolders
+	std::thread thread_;
+	std::mutex mutex_;
+	std::deque<QByteArray> new_roots_;
+	std::atomic<bool> stop_ {false}; // also checked while listing folders
+	i32 unsaved_deliveries_ = 0; // the state isn't saved ahead of the playlist
+	int inotify_fd_ = -1;
+	int wake_fd_ = -1; // an eventfd, wakes the thread up from poll()
+	
+	// Watcher thread only:
+	std::vector<QByteArray> roots_;
+	QHash<QByteArray, watch::Dir> dirs_; // by full path
+	QHash<int, QByteArray> wd_paths_;
+	std::vector<watch::Event> events_;
+	bool modified_ = false; // the state file is out of date
+	bool roots_unsaved_ = false; // to be saved as soon as allowed
+	bool out_of_watches_ = false;
+};
+
+}
@@ -4,21 +4,56 @@
 #include "Song.hpp"
 #include "gui/Playlist.hpp"
 #include "gui/SeekPane.hpp"
+#include "gui/Table.hpp"
+#include "gui/TableModel.hpp"
+#include "Prefetcher.hpp"
+#include "Resumer.hpp"
+#include "WarmPool.hpp"
 
+#include <QTimer>
 #include <QUrl>
 
+#include <algorithm>
+#include <chrono>
+
 namespace quince {
 
+// How long a streaming thread waits for the GUI thread to pick the next song
+static const auto NextSongTimeout = std::chrono::milliseconds(500);
+
+// How long before the end of a song the next one gets read ahead
+static const i64 PrefetchLead = 10 * GST_SECOND;
+
+// The clock ticks this long after a second of the song went by
+static const int ClockSlackMs = 5;
+static const int ScrubTickMs = 100;
+
+// Lets the cursor settle before prerolling the songs around it
+static const int WarmUpDelayMs = 300;
+
+static void
+about_to_finish_cb(GstElement *play_elem, gpointer data)
+{
+	static_cast<GstPlayer*>(data)->AboutToFinish(play_elem);
+}
+
 static gboolean bus_callback(GstBus *bus, GstMessage *msg, gpointer data)
 {
 	quince::App *app = (quince::App*) data;
 	
+	if (!app->player()->is_active(bus))
+		return TRUE; // a warm pipeline prerolling, see WarmPool
+	
 	switch (GST_MESSAGE_TYPE(msg))
 	{
 	case GST_MESSAGE_EOS: {
 		app->ReachedEndOfStream();
 		break;
 	}
+	case GST_MESSAGE_STREAM_START: {
+		app->player()->StreamStarted();
+		break;
+	}
 	case GST_MESSAGE_ERROR: {
 		gchar *debug;
 		GError *error;
@@ -82,39 +117,150 @@ static gboolean bus_callback(GstBus *bus, GstMessage *msg, gpointer data)
 	return TRUE;
 }
 
-GstPlayer::GstPlayer(quince::App *app, int argc, char *argv[])
+GstPlayer::GstPlayer(quince::App *app, int argc, char *argv[],
+	const int max_warm, const i64 prefetch_bytes)
 : app_(app)
 {
 	InitGst(argc, argv);
+	clock_ = new QTimer();
+	clock_->setSingleShot(true);
+	QObject::connect(clock_, &QTimer::timeout, clock_, [this] { ClockTick(); });
+	resumer_ = new Resumer(this);
+	warm_pool_ = new WarmPool(this, max_warm);
+	prefetcher_ = new Prefetcher(prefetch_bytes);
 }
 
 GstPlayer::~GstPlayer()
 {
-	gst_element_set_state(play_elem_, GST_STATE_NULL);
-	gst_object_unref(GST_OBJECT(play_elem_));
+	CancelNext();
+	delete clock_;
+	delete resumer_;
+	delete prefetcher_;
+	delete warm_pool_;
+	DeletePlaybin(play_elem_);
+}
+
+void
+GstPlayer::AboutToFinish(GstElement *elem)
+{ // on a streaming thread, the uri must be set before returning
+	u64 request;
+	{
+		std::lock_guard<std::mutex> guard(next_mutex_);
+		request = ++next_request_;
+	}
+	
+	QMetaObject::invokeMethod(app_, [this, request] {
+		PrepareNext(request);
+	}, Qt::QueuedConnection);
+	
+	std::unique_lock<std::mutex> lock(next_mutex_);
+	const bool answered = next_cv_.wait_for(lock, NextSongTimeout,
+	[this, request] {
+		return next_answered_ == request || next_request_ != request;
+	});
+	
+	if (!answered || next_answered_ != request || next_uri_.isEmpty())
+		return;
+	
+	g_object_set(G_OBJECT(elem), "uri", next_uri_.constData(), NULL);
+	switch_pending_ = true;
+}
+
+void
+GstPlayer::Adopt(GstElement *elem)
+{ // elem is already prerolled at the right spot
+	CancelNext();
+	GstElement *prev = play_elem_;
+	play_elem_ = elem;
+	gst_element_set_state(prev, GST_STATE_NULL);
+	warm_pool_->Give(prev);
+	
+	// Waiting for the old pipeline's async-done is pointless now
+	set_seek_and_pause_.pending = false;
+	set_seek_and_pause_.pending2 = false;
+}
+
+void
+GstPlayer::CancelNext()
+{ // the uri is about to be changed by hand
+	{
+		std::lock_guard<std::mutex> guard(next_mutex_);
+		next_request_++;
+		switch_pending_ = false;
+	}
+	
+	next_cv_.notify_all();
+}
+
+void
+GstPlayer::ClockTick()
+{
+	if (GST_STATE_TARGET(play_elem_) != GST_STATE_PLAYING)
+		return; // restarted by FinishUpPlayFunction()
+	
+	app_->UpdatePlayingSongPosition(-1, app_->isVisible());
+	gui::Playlist *visible = app_->GetVisiblePlaylist();
+	
+	if (visible != nullptr)
+		visible->table_model()->PositionTicked();
+	
+	ScheduleTick();
+}
+
+void
+GstPlayer::DeletePlaybin(GstElement *elem)
+{
+	gst_element_set_state(elem, GST_STATE_NULL);
+	GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(elem));
+	gst_bus_remove_watch(bus);
+	gst_object_unref(bus);
+	gst_object_unref(GST_OBJECT(elem));
 }
 
 void
 GstPlayer::FinishUpPlayFunction(Song *song)
 {
-	if (song != nullptr)
+	if (song != nullptr) {
 		song->state(GST_STATE_PLAYING);
+		Refresh(song);
+	}
 	
 	auto pair = quince::audio::PlaylistSong {app_->active_playlist()->id(), song};
 	app_->seek_pane()->SetCurrentOrUpdate(pair);
 	gst_element_set_state(play_elem_, GST_STATE_PLAYING);
 	app_->UpdatePlayIcon(GST_STATE_PAUSED);
 	app_->last_play_state(GST_STATE_PLAYING);
+	ScheduleTick();
+	WarmUpSoon();
 }
 
 void
 GstPlayer::InitGst(int argc, char *argv[])
 {
 	gst_init(&argc, &argv);
-	play_elem_ = gst_element_factory_make("playbin", "play");
-	GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(play_elem_));
+	play_elem_ = NewPlaybin();
+}
+
+bool
+GstPlayer::is_active(GstBus *bus) const
+{
+	GstBus *active = gst_pipeline_get_bus(GST_PIPELINE(play_elem_));
+	gst_object_unref(active);
+	
+	return bus == active;
+}
+
+GstElement*
+GstPlayer::NewPlaybin()
+{
+	GstElement *elem = gst_element_factory_make("playbin", nullptr);
+	GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(elem));
 	gst_bus_add_watch(bus, bus_callback, app_);// loop_);
 	gst_object_unref(bus);
+	g_signal_connect(elem, "about-to-finish",
+		G_CALLBACK(about_to_finish_cb), this);
+	
+	return elem;
 }
 
 void
@@ -128,9 +274,11 @@ GST_STATE_PAUSED – the element is PAUSED, it is ready to accept and process da
 GST_STATE_PLAYING – the element is PLAYING, the GstClock is running and the data is flowing. 
 */
 	gst_element_set_state(play_elem_, GST_STATE_PAUSED);
+	clock_->stop();
 	
 	if (song != nullptr) {
 		song->state(GST_STATE_PAUSED);
+		Refresh(song);
 		//app_->seek_pane()->SetCurrentOrUpdate(song);
 	}
 	
@@ -149,8 +297,18 @@ GstPlayer::Play(Song *song)
 	const bool is_a_new_song = song != temp_song_info_.song;
 	song->FillIn(temp_song_info_);
 	
+	if (is_a_new_song)
+		SongStarting(song);
+	
+	// From the start, so a prerolled pipeline will do
+	if (is_a_new_song && song->position() <= 0 && TakeWarm(song)) {
+		FinishUpPlayFunction(song);
+		return;
+	}
+	
 	if (is_a_new_song || !song->is_playing_or_paused())
 	{
+		CancelNext();
 		gst_element_set_state(play_elem_, GST_STATE_NULL);
 		auto ba = song->uri().toLocal8Bit();
 		g_object_set(G_OBJECT(play_elem_), "uri", ba.data(), NULL);
@@ -164,6 +322,118 @@ GstPlayer::Play(Song *song)
 	}
 }
 
+void
+GstPlayer::PositionChanged(const audio::TempSongInfo &tsi)
+{
+	if (tsi.song == nullptr || tsi.song == prefetched_for_ || tsi.duration <= 0)
+		return;
+	
+	if (tsi.duration - tsi.position > PrefetchLead)
+		return;
+	
+	prefetched_for_ = tsi.song;
+	Song *next = app_->PeekNextSong().song;
+	
+	if (next != nullptr)
+		prefetcher_->Request(next->full_path().toLocal8Bit());
+}
+
+void
+GstPlayer::PrepareNext(const u64 request)
+{
+	const audio::PlaylistSong next = app_->PeekNextSong();
+	QByteArray uri;
+	
+	if (next.song != nullptr)
+		uri = next.song->uri().toLocal8Bit();
+	
+	{
+		std::lock_guard<std::mutex> guard(next_mutex_);
+		
+		if (request != next_request_)
+			return; // too late or cancelled
+		
+		next_uri_ = uri;
+		next_ = next;
+		next_answered_ = request;
+	}
+	
+	next_cv_.notify_all();
+}
+
+void
+GstPlayer::Refresh(Song *song)
+{ // shows the song's new state and position in its row
+	gui::Playlist *playlist = app_->PickPlaylist(song->playlist_id());
+	
+	if (playlist != nullptr && playlist->has(song))
+		playlist->table_model()->Changed(song);
+}
+
+void
+GstPlayer::Resume(Song *song)
+{ // the song that was paused when the app quit
+	GstElement *elem = nullptr;
+	
+	if (resumer_ != nullptr) {
+		elem = resumer_->Take(song->uri().toLocal8Bit(), song->position());
+		
+		if (resumer_->done())
+		{ // else it's deleted at exit, by then it gave up
+			delete resumer_;
+			resumer_ = nullptr;
+		}
+	}
+	
+	if (elem == nullptr) {
+		SetSeekAndPause_Start(song, nullptr);
+		return;
+	}
+	
+	Adopt(elem);
+	auto pair = quince::audio::PlaylistSong {app_->active_playlist()->id(), song};
+	app_->seek_pane()->SetCurrentOrUpdate(pair);
+	app_->UpdatePlayIcon(GST_STATE_PLAYING);
+	app_->UpdatePlayingSongPosition(song->position(), true);
+}
+
+void
+GstPlayer::ScheduleTick()
+{
+	const i64 pos = temp_song_info_.position;
+	int ms = 1000;
+	
+	if (!app_->visible())
+	{ // hidden to the tray
+		const audio::TempSongInfo &tsi = temp_song_info_;
+		
+		if (tsi.song == nullptr || tsi.song == prefetched_for_ || tsi.duration <= 0) {
+			clock_->stop();
+			return;
+		}
+		
+		const i64 until_prefetch = tsi.duration - PrefetchLead - std::max(pos, i64(0));
+		clock_->start(int(std::max(until_prefetch, i64(0)) / 1000000L));
+		return;
+	}
+	
+	if (scrubbing_)
+		ms = ScrubTickMs;
+	else if (pos >= 0)
+		ms = 1000 - int((pos / 1000000L) % 1000) + ClockSlackMs;
+	
+	clock_->start(ms);
+}
+
+void
+GstPlayer::scrubbing(const bool flag)
+{
+	scrubbing_ = flag;
+	
+	if (clock_->isActive())
+		ScheduleTick();
+}
+
 void
 GstPlayer::SeekTo(const i64 new_pos)
 {
@@ -184,6 +454,7 @@ GstPlayer::SetSeekAndPause_Start(Song *song, PlayMethod play_method)
 		return;
 	}
 	
+	CancelNext();
 	gst_element_set_state(play_elem_, GST_STATE_NULL);
 	auto ba = song->uri().toLocal8Bit();
 	g_object_set(G_OBJECT(play_elem_), "uri", ba.data(), NULL);
@@ -225,14 +496,135 @@ GstPlayer::StopPlaying(const quince::audio::PlaylistSong &pair)
 	if (!playlist->has(pair.song))
 		song = nullptr;
 	
+	CancelNext();
 	gst_element_set_state(play_elem_, GST_STATE_NULL);
+	clock_->stop();
 	
 	if (song != nullptr) {
 		song->position(-1);
 		song->state(GST_STATE_NULL);
+		playlist->table_model()->Changed(song);
 	}
 	
 	app_->seek_pane()->SetCurrentOrUpdate(pair);
 }
 
+void
+GstPlayer::StreamStarted()
+{
+	audio::PlaylistSong next;
+	{
+		std::lock_guard<std::mutex> guard(next_mutex_);
+		
+		if (!switch_pending_)
+			return; // started by Play()
+		
+		switch_pending_ = false;
+		next = next_;
+	}
+	
+	// The previous song is done, as if it had ended with an EOS
+	gui::Playlist *playlist = app_->PickPlaylist(temp_song_info_.playlist_id);
+	Song *prev = temp_song_info_.song;
+	
+	if (playlist != nullptr && prev != nullptr && playlist->has(prev)) {
+		prev->position(-1);
+		prev->state(GST_STATE_NULL);
+		playlist->table_model()->Changed(prev);
+	}
+	
+	playlist = app_->PickPlaylist(next.playlist_id);
+	
+	if (playlist == nullptr || !playlist->has(next.song))
+	{ // removed meanwhile, its file plays on anyway
+		temp_song_info_ = {};
+		return;
+	}
+	
+	Song *song = next.song;
+	SongStarting(song);
+	song->state(GST_STATE_PLAYING);
+	song->FillIn(temp_song_info_);
+	playlist->table_model()->Changed(song);
+	app_->seek_pane()->SetCurrentOrUpdate(next);
+	ScheduleTick(); // realigns to the new song
+	WarmUpSoon();
+}
+
+void
+GstPlayer::SongStarting(Song *song)
+{
+	prefetcher_->Started(song->full_path().toLocal8Bit());
+	prefetched_for_ = nullptr;
+}
+
+bool
+GstPlayer::TakeWarm(Song *song)
+{
+	GstElement *warm = warm_pool_->Take(song->uri().toLocal8Bit());
+	
+	if (warm == nullptr)
+		return false;
+	
+	Adopt(warm);
+	
+	return true;
+}
+
+void
+GstPlayer::WarmUp()
+{ // the next song, the one under the cursor, then the previous one
+	std::vector<QByteArray> uris;
+	auto add = [this, &uris] (Song *song) {
+		if (song == nullptr || song == temp_song_info_.song)
+			return;
+		QByteArray uri = song->uri().toLocal8Bit();
+		if (std::find(uris.begin(), uris.end(), uri) == uris.end())
+			uris.push_back(uri);
+	};
+	
+	auto *vec = app_->active_playlist_songs();
+	int index = -1;
+	
+	if (vec != nullptr && app_->GetCurrentSong(&index) != nullptr)
+		add(app_->PeekNextSong().song);
+	
+	gui::Playlist *visible = app_->GetVisiblePlaylist();
+	
+	if (visible != nullptr) {
+		const int row = visible->table()->currentIndex().row();
+		QVector<Song*> &songs = visible->songs();
+		
+		if (row >= 0 && row < songs.size())
+			add(songs[row]);
+	}
+	
+	if (index > 0)
+		add((*vec)[index - 1]);
+	
+	warm_pool_->Keep(uris);
+}
+
+void
+GstPlayer::WindowShown(const bool shown)
+{
+	if (GST_STATE_TARGET(play_elem_) == GST_STATE_PLAYING)
+		ClockTick(); // reschedules itself for the new mode
+	else if (shown)
+		app_->UpdatePlayingSongPosition(-1, true);
+}
+
+void
+GstPlayer::WarmUpSoon()
+{
+	if (warm_up_scheduled_)
+		return;
+	
+	warm_up_scheduled_ = true;
+	QTimer::singleShot(WarmUpDelayMs, app_, [this] {
+		warm_up_scheduled_ = false;
+		WarmUp();
+	});
+}
+
 }
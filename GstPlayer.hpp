@@ -7,28 +7,43 @@
 #include "gui/decl.hxx"
 #include "types.hxx"
 
+#include <QByteArray>
 #include <QString>
+#include <QTimer>
 #include <gst/gst.h>
 
+#include <condition_variable>
+#include <mutex>
+
 namespace quince {
 
 typedef void(GstPlayer::*PlayMethod)(Song *song);
 
 class GstPlayer {
 public:
-	GstPlayer(quince::App *app, int argc, char *argv[]);
+	GstPlayer(quince::App *app, int argc, char *argv[], const int max_warm,
+		const i64 prefetch_bytes);
 	virtual ~GstPlayer();
 	
-	
+	void AboutToFinish(GstElement *elem);
+	void DeletePlaybin(GstElement *elem);
 	void FinishUpPlayFunction(Song *song);
+	bool is_active(GstBus *bus) const;
+	GstElement* NewPlaybin();
 	GstElement* play_elem() const { return play_elem_; }
 	void Pause(Song *song);
 	void Play(Song *song);
+	void PositionChanged(const audio::TempSongInfo &tsi);
+	void Resume(Song *song);
+	void scrubbing(const bool flag);
 	void SeekTo(const i64 new_pos);
 	void SetSeekAndPause_Start(Song *song, PlayMethod play_method);
 	void SetSeekAndPause_Finish();
 	void StopPlaying(const audio::PlaylistSong &pair);
+	void StreamStarted();
 	audio::TempSongInfo& temp_song_info() { return temp_song_info_; }
+	void WarmUpSoon();
+	void WindowShown(const bool shown);
 	
 	struct set_seek_and_pause {
 		bool pending = false;
@@ -43,10 +58,47 @@ public:
 private:
 	NO_ASSIGN_COPY_MOVE(GstPlayer);
 	
+	void Adopt(GstElement *elem);
+	void CancelNext();
+	void ClockTick();
 	void InitGst(int argc, char *argv[]);
+	void PrepareNext(const u64 request);
+	void Refresh(Song *song);
+	void ScheduleTick();
+	void SongStarting(Song *song);
+	bool TakeWarm(Song *song);
+	void WarmUp();
 	
 	GstElement *play_elem_ = nullptr;
 	quince::App *app_ = nullptr;
 	audio::TempSongInfo temp_song_info_ = {};
+	
+	/* The one clock that refreshes the playing position in the GUI (the
+	 seek pane and the visible table), it only runs while playing. It
+	 ticks right after each second of the song so the time shown flips
+	 on time, and faster while the user drags the seek slider. While the
+	 window is hidden to the tray it only wakes up once per song, to read
+	 the next one ahead. */
+	QTimer *clock_ = nullptr;
+	bool scrubbing_ = false;
+	
+	WarmPool *warm_pool_ = nullptr; // the neighbours of the playing song
+	bool warm_up_scheduled_ = false;
+	Prefetcher *prefetcher_ = nullptr; // the start of the next song
+	Song *prefetched_for_ = nullptr; // only compared, might be deleted
+	Resumer *resumer_ = nullptr; // until the first Resume() or, if not done by then, exit
+	
+	/* Gapless playback: shortly before a song ends playbin asks for the
+	 next uri on a streaming thread, which gets it from the GUI thread
+	 and queues it. The GUI switches over to the next song once its
+	 stream actually starts. If the GUI doesn't answer in time the song
+	 ends with an EOS and the next one is played the old way. */
+	std::mutex next_mutex_;
+	std::condition_variable next_cv_;
+	u64 next_request_ = 0; // bumped per request and when it's cancelled
+	u64 next_answered_ = 0;
+	QByteArray next_uri_; // empty if playback stops after this song
+	audio::PlaylistSong next_ = {};
+	bool switch_pending_ = false; // next_uri_ was queued in playbin
 };
 }
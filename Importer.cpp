@@ -0,0 +1,410 @@
+#include "Importer.hpp"
+
+#include "App.hpp"
+#include "audio.hh"
+#include "FolderWatcher.hpp"
+#include "gui/Playlist.hpp"
+#include "gui/TableModel.hpp"
+#include "io/io.hh"
+#include "io/Walker.hpp"
+#include "Song.hpp"
+
+#include <algorithm>
+#include <string.h>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace quince {
+
+static const i32 RowBatchSize = 512;
+static const int WalkThreads = 8; // mostly waiting on the file system
+
+Importer::Importer(App *app, const int max_depth) : app_(app),
+max_depth_(max_depth)
+{
+	const unsigned cores = std::thread::hardware_concurrency();
+	const unsigned worker_count = (cores == 0) ? 2 : cores;
+	walker_ = std::thread(&Importer::WalkLoop, this);
+	
+	for (unsigned i = 0; i < worker_count; i++)
+		workers_.emplace_back(&Importer::ParseLoop, this);
+}
+
+Importer::~Importer()
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		stop_ = true;
+	}
+	
+	walk_cv_.notify_all();
+	jobs_cv_.notify_all();
+	walker_.join();
+	
+	for (std::thread &t: workers_)
+		t.join();
+	
+	meta_cache_.Save();
+}
+
+void
+Importer::AddSong(const io::File &file, import::Batch &batch)
+{
+	Song *song = Song::FromFile(file, batch.playlist_id);
+	
+	if (song == nullptr)
+		return;
+	
+	import::Job job;
+	job.song = song;
+	job.full_path = file.build_full_path().toLocal8Bit();
+	job.codec = song->meta().audio_codec();
+	job.key.id = file.id;
+	job.key.size = file.size;
+	job.key.mtime = file.mtime;
+	batch.songs.append(song);
+	batch.jobs.append(job);
+	
+	if (batch.songs.size() >= RowBatchSize)
+		Flush(batch, false);
+}
+
+void
+Importer::DeliverResults()
+{
+	std::vector<import::Result> results;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		results.swap(results_);
+		results_scheduled_ = false;
+	}
+	
+	QVector<Song*> to_discover;
+	QHash<gui::Playlist*, QVector<Song*>> parsed; // their new tags get journaled
+	
+	for (import::Result &result: results)
+	{
+		auto it = pending_.find(result.song);
+		
+		// The song got removed from its playlist in the meantime
+		if (it == pending_.end() || it.value() != result.ticket)
+			continue;
+		
+		pending_.erase(it);
+		Song *song = result.song;
+		
+		if (result.ok)
+			song->meta() = result.meta;
+		
+		gui::Playlist *playlist = app_->PickPlaylist(song->playlist_id());
+		
+		if (playlist != nullptr)
+		{
+			playlist->table_model()->Changed(song);
+			
+			if (result.ok)
+				parsed[playlist].append(song);
+		}
+		
+		if (!result.cached && !result.exact)
+			to_discover.append(song);
+	}
+	
+	// The journal got the new songs without their tags, which now follow
+	// as one entry per playlist for this whole lot.
+	for (auto it = parsed.cbegin(); it != parsed.cend(); it++)
+	{
+		gui::Playlist *playlist = it.key();
+		gui::TableModel *model = playlist->table_model();
+		QVector<i32> rows;
+		QVector<Song*> songs;
+		
+		for (Song *song: it.value())
+		{
+			const i32 row = model->RowOf(song);
+			
+			if (row != -1) {
+				rows.append(row);
+				songs.append(song);
+			}
+		}
+		
+		playlist->journal().Update(rows, songs);
+		app_->SavePlaylistEdits(playlist);
+	}
+	
+	if (!to_discover.isEmpty())
+		app_->AddBatch(to_discover);
+}
+
+void
+Importer::DeliverRows(import::Batch batch, const bool last)
+{
+	gui::Playlist *playlist = app_->PickPlaylist(batch.playlist_id);
+	
+	if (playlist == nullptr)
+	{ // deleted while its files were being listed
+		for (Song *song: batch.songs)
+			delete song;
+		
+		if (last)
+			skipped_ = 0;
+		
+		return;
+	}
+	
+	// Files the playlist has already (or that were dropped twice) are
+	// skipped, which moves the rows of the next batches up.
+	gui::TableModel *model = playlist->table_model();
+	i32 at = batch.at_vec_index - skipped_;
+	QVector<Song*> songs;
+	std::vector<import::Job> jobs;
+	std::unordered_set<io::FileID, io::FileIDHash> batch_ids;
+	
+	for (i32 i = 0; i < batch.songs.size(); i++)
+	{
+		Song *song = batch.songs[i];
+		const io::FileID &id = song->file_id();
+		
+		if (id.Initialized() && (model->has_file(id) || !batch_ids.insert(id).second)) {
+			delete song;
+			skipped_++;
+			continue;
+		}
+		
+		songs.append(song);
+		jobs.push_back(batch.jobs[i]);
+	}
+	
+	if (last)
+		skipped_ = 0;
+	
+	if (!songs.isEmpty())
+	{
+		if (at > playlist->songs().size())
+			at = playlist->songs().size();
+		
+		model->InsertRows(at, songs);
+		playlist->journal().Insert(at, songs);
+		
+		for (import::Job &job: jobs) {
+			job.ticket = next_ticket_++;
+			pending_.insert(job.song, job.ticket);
+		}
+		
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			
+			for (import::Job &job: jobs)
+				jobs_.push_back(job);
+		}
+		
+		jobs_cv_.notify_all();
+		app_->UpdatePlaylistDuration(playlist);
+	}
+	
+	// Saved right away, later edits refer to these rows
+	if (!songs.isEmpty() || last)
+		app_->SavePlaylistEdits(playlist);
+	
+	if (last && batch.from_watcher && playlist->watcher() != nullptr)
+		playlist->watcher()->Persisted();
+}
+
+void
+Importer::Flush(import::Batch &batch, const bool last)
+{
+	import::Batch next;
+	next.playlist_id = batch.playlist_id;
+	next.at_vec_index = batch.at_vec_index + batch.songs.size();
+	next.from_watcher = batch.from_watcher;
+	std::swap(next, batch);
+	
+	QMetaObject::invokeMethod(app_, [this, next, last] {
+		DeliverRows(next, last);
+	}, Qt::QueuedConnection);
+}
+
+void
+Importer::Forget(Song *song)
+{
+	pending_.remove(song);
+}
+
+void
+Importer::Import(QVector<io::File> &files, gui::Playlist *playlist,
+	i32 at_vec_index, const bool from_watcher)
+{
+	CHECK_PTR_VOID(playlist);
+	import::WalkRequest request;
+	request.files = files;
+	request.playlist_id = playlist->id();
+	request.at_vec_index = at_vec_index;
+	request.from_watcher = from_watcher;
+	
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		walk_requests_.push_back(request);
+	}
+	
+	walk_cv_.notify_one();
+}
+
+void
+Importer::ParseLoop()
+{
+	while (true)
+	{
+		import::Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			jobs_cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+			
+			if (stop_)
+				return;
+			
+			job = jobs_.front();
+			jobs_.pop_front();
+		}
+		
+		import::Result result;
+		result.song = job.song;
+		result.ticket = job.ticket;
+		
+		if (meta_cache_.Lookup(job.key, result.meta)) {
+			result.ok = result.cached = true;
+		} else {
+			result.meta.audio_codec(job.codec);
+			result.ok = audio::ReadFileMeta(job.full_path.data(),
+				result.meta, result.exact);
+			
+			if (result.exact)
+				meta_cache_.Store(job.key, result.meta);
+		}
+		
+		bool schedule = false;
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			results_.push_back(result);
+			
+			if (!results_scheduled_) {
+				// Whatever arrives until the GUI thread gets to it
+				// is delivered in the same batch.
+				results_scheduled_ = true;
+				schedule = true;
+			}
+		}
+		
+		if (schedule) {
+			QMetaObject::invokeMethod(app_, [this] {
+				DeliverResults();
+			}, Qt::QueuedConnection);
+		}
+	}
+}
+
+void
+Importer::StoreMeta(Song *song)
+{
+	// Called once the discoverer filled in the rest of the song's info
+	auto path_ba = song->full_path().toLocal8Bit();
+	audio::MetaCacheKey key;
+	
+	if (audio::MetaCache::KeyFromPath(path_ba.data(), key))
+		meta_cache_.Store(key, song->meta());
+}
+
+void
+Importer::WalkLoop()
+{
+	meta_cache_.Load();
+	
+	while (true)
+	{
+		import::WalkRequest request;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			walk_cv_.wait(lock, [this] {
+				return stop_ || !walk_requests_.empty();
+			});
+			
+			if (stop_)
+				return;
+			
+			request = walk_requests_.front();
+			walk_requests_.pop_front();
+		}
+		
+		import::Batch batch;
+		batch.playlist_id = request.playlist_id;
+		batch.at_vec_index = request.at_vec_index;
+		batch.from_watcher = request.from_watcher;
+		
+		// Same order as the Walker uses for what it finds,
+		// names converted once rather than on every comparison
+		std::vector<std::pair<QByteArray, i32>> order;
+		order.reserve(request.files.size());
+		
+		for (i32 i = 0; i < request.files.size(); i++)
+			order.push_back({request.files[i].name.toLocal8Bit(), i});
+		
+		std::sort(order.begin(), order.end(),
+		[] (const std::pair<QByteArray, i32> &a,
+			const std::pair<QByteArray, i32> &b) {
+			return strverscmp(a.first.constData(), b.first.constData()) < 0;
+		});
+		
+		QVector<io::File> sorted;
+		sorted.reserve(request.files.size());
+		
+		for (const auto &pair: order)
+			sorted.append(request.files[pair.second]);
+		
+		request.files.swap(sorted);
+		
+		for (io::File &file: request.files)
+		{
+			if (file.is_regular())
+				AddSong(file, batch);
+		}
+		
+		io::WalkOptions options;
+		options.max_depth = max_depth_;
+		options.threads = WalkThreads;
+		options.filter = io::IsSongFileName;
+		io::Walker walker(options);
+		QByteArray dir_path_ba;
+		QString dir_path;
+		
+		auto add_song = [&] (const io::WalkEntry &entry) {
+			if (*entry.dir_path != dir_path_ba) { // once per folder
+				dir_path_ba = *entry.dir_path;
+				dir_path = QString::fromLocal8Bit(dir_path_ba);
+			}
+			
+			io::File file;
+			io::FillIn(file, *entry.st, dir_path,
+				QString::fromLocal8Bit(entry.name, entry.name_len));
+			AddSong(file, batch);
+			
+			return !stop_;
+		};
+		
+		// All the trees at once, so that they share the walker's threads
+		QVector<QString> dir_paths;
+		
+		for (io::File &file: request.files)
+		{
+			if (file.is_dir())
+				dir_paths.append(file.build_full_path());
+		}
+		
+		if (!dir_paths.isEmpty())
+			walker.Walk(dir_paths, add_song);
+		
+		Flush(batch, true);
+	}
+}
+
+}
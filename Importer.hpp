@@ -0,0 +1,111 @@
+#pragma once
+
+#include "audio.hxx"
+#include "audio/Meta.hpp"
+#include "audio/MetaCache.hpp"
+#include "decl.hxx"
+#include "err.hpp"
+#include "gui/decl.hxx"
+#include "io/File.hpp"
+#include "types.hxx"
+
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace quince {
+
+namespace import {
+
+struct Job {
+	Song *song = nullptr; // a handle only, never dereferenced off the GUI thread
+	u64 ticket = 0;
+	QByteArray full_path;
+	audio::Codec codec = audio::Codec::Unknown;
+	audio::MetaCacheKey key = {};
+};
+
+struct Result {
+	Song *song = nullptr;
+	u64 ticket = 0;
+	audio::Meta meta = {};
+	bool ok = false;
+	bool cached = false;
+	bool exact = false; // nothing left for the discoverer to fill in
+};
+
+struct WalkRequest {
+	QVector<io::File> files;
+	i64 playlist_id = -1;
+	i32 at_vec_index = 0;
+	bool from_watcher = false;
+};
+
+struct Batch {
+	i64 playlist_id = -1;
+	i32 at_vec_index = 0;
+	bool from_watcher = false; // see FolderWatcher::Persisted()
+	QVector<Song*> songs;
+	QVector<Job> jobs;
+};
+
+}
+
+/* Adds files to playlists without blocking the GUI thread:
+ 1) a walker thread expands folders and creates the songs,
+ 2) the rows are inserted on the GUI thread in batches right away,
+ skipping the files (by io::FileID) the playlist has already,
+ 3) a pool of worker threads parses the tags of the new songs unless
+ they're found in the metadata cache,
+ 4) the parsed metadata is applied on the GUI thread in batches, songs
+ whose codec has no complete native probe then go to the discoverer. */
+class Importer {
+public:
+	Importer(App *app, const int max_depth);
+	virtual ~Importer();
+	
+	void Forget(Song *song);
+	void Import(QVector<io::File> &files, gui::Playlist *playlist, i32 at_vec_index,
+		const bool from_watcher = false);
+	bool is_pending(Song *song) const { return pending_.contains(song); }
+	audio::MetaCache& meta_cache() { return meta_cache_; }
+	void StoreMeta(Song *song);
+
+private:
+	NO_ASSIGN_COPY_MOVE(Importer);
+	
+	void AddSong(const io::File &file, import::Batch &batch);
+	void DeliverResults();
+	void DeliverRows(import::Batch batch, const bool last);
+	void Flush(import::Batch &batch, const bool last);
+	void ParseLoop();
+	void WalkLoop();
+	
+	App *app_ = nullptr;
+	const int max_depth_; // folder levels listed, 1 = no subfolders
+	audio::MetaCache meta_cache_;
+	std::thread walker_;
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable walk_cv_;
+	std::condition_variable jobs_cv_;
+	std::deque<import::WalkRequest> walk_requests_;
+	std::deque<import::Job> jobs_;
+	std::vector<import::Result> results_;
+	bool results_scheduled_ = false;
+	std::atomic<bool> stop_ {false};
+	
+	// GUI thread only:
+	QHash<Song*, u64> pending_;
+	u64 next_ticket_ = 1;
+	i32 skipped_ = 0; // duplicates so far in the files being delivered
+};
+
+}
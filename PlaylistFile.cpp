@@ -0,0 +1,190 @@
+#include "PlaylistFile.hpp"
+
+#include "App.hpp"
+#include "ByteArray.hpp"
+#include "dirs.hh"
+#include "Song.hpp"
+
+#include <string.h>
+#include <unordered_map>
+
+namespace quince {
+
+PlaylistFile::PlaylistFile() {}
+PlaylistFile::~PlaylistFile() {}
+
+void
+PlaylistFile::InternDirs(std::vector<u32> &ids) const
+{ // maps the file's dir indices to process wide dir ids
+	const PlaylistHeader *h = header();
+	const char *heap = file_.data() + h->heap_offset;
+	const u32 count = h->dir_count;
+	ids.resize(count);
+	
+	for (u32 i = 0; i < count; i++)
+	{
+		u32 pair[2];
+		memcpy(pair, heap + h->dirs_offset + i * sizeof pair, sizeof pair);
+		QString path;
+		
+		if (i64(pair[0]) + pair[1] <= h->heap_size)
+			path = QString::fromLocal8Bit(heap + pair[0], pair[1]);
+		
+		ids[i] = dirs::Intern(path);
+	}
+}
+
+bool
+PlaylistFile::Map(const QString &full_path)
+{
+	return file_.Open(full_path) == io::Err::Ok;
+}
+
+QString
+PlaylistFile::name() const
+{
+	const PlaylistHeader *h = header();
+	const char *heap = file_.data() + h->heap_offset;
+	
+	return QString::fromLocal8Bit(heap + h->name_offset, h->name_len);
+}
+
+const SongRecord*
+PlaylistFile::record(const i32 index) const
+{
+	const PlaylistHeader *h = header();
+	const char *p = file_.data() + h->records_offset + i64(index) * h->record_size;
+	
+	return reinterpret_cast<const SongRecord*>(p);
+}
+
+bool
+PlaylistFile::RecordIsValid(const SongRecord *r) const
+{
+	const PlaylistHeader *h = header();
+	const i64 at = reinterpret_cast<const char*>(r) - file_.data();
+	
+	if (at + r->heap_delta != h->heap_offset)
+		return false;
+	
+	const i64 max = h->heap_size;
+	
+	return i64(r->filename_offset) + r->filename_len <= max &&
+		r->dir_index < h->dir_count &&
+		i64(r->genres_offset) + r->genre_count * sizeof(i16) <= max;
+}
+
+void
+PlaylistFile::Serialize(const QVector<Song*> &songs, const i64 id,
+	const QString &name, const bool is_active, const i64 generation,
+	quince::ByteArray &ba)
+{
+	const i32 count = songs.size();
+	ByteArray heap;
+	std::vector<SongRecord> records(count);
+	std::unordered_map<u32, u32> dir_indices; // dir id => index in this file
+	std::vector<u32> dir_ids;
+	
+	for (i32 i = 0; i < count; i++)
+	{
+		const u32 dir_id = songs[i]->dir_id();
+		auto it = dir_indices.find(dir_id);
+		u32 dir_index;
+		
+		if (it == dir_indices.end()) {
+			dir_index = dir_ids.size();
+			dir_indices[dir_id] = dir_index;
+			dir_ids.push_back(dir_id);
+		} else {
+			dir_index = it->second;
+		}
+		
+		songs[i]->SaveTo(records[i], heap, dir_index);
+	}
+	
+	std::vector<u32> dir_pairs;
+	dir_pairs.reserve(dir_ids.size() * 2);
+	
+	for (const u32 dir_id: dir_ids) {
+		auto ba = dirs::Get(dir_id).toLocal8Bit();
+		dir_pairs.push_back(heap.size());
+		dir_pairs.push_back(ba.size());
+		heap.add(ba.data(), ba.size());
+	}
+	
+	PlaylistHeader h = {};
+	h.version = PlaylistCacheVersion;
+	h.is_active = is_active ? 1 : 0;
+	h.id = id;
+	h.generation = generation;
+	h.song_count = count;
+	h.record_size = sizeof(SongRecord);
+	auto name_ba = name.toLocal8Bit();
+	h.name_offset = heap.size();
+	h.name_len = name_ba.size();
+	heap.add(name_ba.data(), name_ba.size());
+	h.dir_count = dir_ids.size();
+	h.dirs_offset = heap.size();
+	
+	if (!dir_pairs.empty()) {
+		heap.add(reinterpret_cast<const char*>(dir_pairs.data()),
+			dir_pairs.size() * sizeof(u32));
+	}
+	h.records_offset = sizeof(PlaylistHeader);
+	h.heap_offset = h.records_offset + i64(count) * sizeof(SongRecord);
+	h.heap_size = heap.size();
+	
+	for (i32 i = 0; i < count; i++) {
+		const i64 record_at = h.records_offset + i64(i) * sizeof(SongRecord);
+		records[i].heap_delta = h.heap_offset - record_at;
+	}
+	
+	ba.add(reinterpret_cast<const char*>(&h), sizeof h);
+	
+	if (count > 0) {
+		ba.add(reinterpret_cast<const char*>(records.data()),
+			records.size() * sizeof(SongRecord));
+	}
+	
+	if (heap.size() > 0)
+		ba.add(heap.data(), heap.size());
+}
+
+bool
+PlaylistFile::Validate() const
+{
+	const i32 v = version();
+	
+	if (v != PlaylistCacheVersion && v != PlaylistCacheVersionNoFileIDs)
+		return false;
+	
+	if (file_.size() < i64(sizeof(PlaylistHeader)))
+		return false;
+	
+	const PlaylistHeader *h = header();
+	const i64 records_end = h->records_offset +
+		i64(h->song_count) * h->record_size;
+	const u32 record_size = (v == PlaylistCacheVersion) ?
+		sizeof(SongRecord) : SongRecordSizeNoFileIDs;
+	
+	return h->record_size == record_size && h->song_count >= 0 &&
+		h->records_offset >= i64(sizeof(PlaylistHeader)) &&
+		records_end <= h->heap_offset &&
+		h->heap_offset + h->heap_size <= file_.size() &&
+		i64(h->name_offset) + h->name_len <= h->heap_size &&
+		i64(h->dirs_offset) + i64(h->dir_count) * 2 * sizeof(u32) <= h->heap_size;
+}
+
+i32
+PlaylistFile::version() const
+{
+	if (!file_.is_open() || file_.size() < i64(sizeof(i32)))
+		return -1;
+	
+	i32 n;
+	memcpy(&n, file_.data(), sizeof n);
+	
+	return n;
+}
+
+}
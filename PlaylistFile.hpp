@@ -0,0 +1,114 @@
+#pragma once
+
+#include "decl.hxx"
+#include "err.hpp"
+#include "io/MappedFile.hpp"
+#include "types.hxx"
+
+#include <QString>
+#include <QVector>
+
+#include <vector>
+
+namespace quince {
+
+/* Playlist file layout (native byte order), meant to be mmap()ed and
+ read in place:
+ PlaylistHeader | SongRecord[song_count] | string heap
+ All strings live in the heap and are referenced by offset & length,
+ they're only turned into QStrings when they're actually needed.
+ Each folder is stored once: the heap has a table of dir_count
+ (u32 offset, u32 length) pairs which SongRecord::dir_index points into. */
+
+struct PlaylistHeader {
+	i32 version;
+	u8 is_active;
+	u8 reserved[3];
+	i64 id;
+	i32 song_count;
+	u32 record_size;
+	u32 name_offset;
+	u32 name_len;
+	i64 records_offset;
+	i64 heap_offset;
+	i64 heap_size;
+	i64 generation; // see PlaylistJournal.hpp
+	u32 dirs_offset;
+	u32 dir_count;
+};
+
+struct SongRecord {
+	i64 position;
+	i64 duration;
+	i64 heap_delta; // from this record to the start of the string heap
+	u32 filename_offset;
+	u32 filename_len;
+	u32 dir_index;
+	u32 genres_offset; // i16 array
+	i32 state;
+	i32 sample_rate;
+	i32 bitrate;
+	i8 channels;
+	i8 bits_per_sample;
+	u8 codec;
+	u8 bits;
+	u8 genre_count;
+	u8 reserved[7];
+	u64 device_id; // the file's io::FileID, since version 6
+	u64 inode_number;
+	
+	const char*
+	heap() const { return reinterpret_cast<const char*>(this) + heap_delta; }
+};
+
+static_assert(sizeof(PlaylistHeader) == 72);
+static_assert(sizeof(SongRecord) == 80);
+static const u32 SongRecordSizeNoFileIDs = 64;
+
+class PlaylistFile {
+public:
+	PlaylistFile();
+	virtual ~PlaylistFile();
+	
+	const PlaylistHeader*
+	header() const { return reinterpret_cast<const PlaylistHeader*>(file_.data()); }
+	
+	void
+	InternDirs(std::vector<u32> &ids) const;
+	
+	bool
+	Map(const QString &full_path);
+	
+	QString
+	name() const;
+	
+	// Older files are read but their songs get no io::FileID
+	bool
+	has_file_ids() const { return header()->record_size >= sizeof(SongRecord); }
+	
+	const SongRecord*
+	record(const i32 index) const;
+	
+	bool
+	RecordIsValid(const SongRecord *record) const;
+	
+	static void
+	Serialize(const QVector<Song*> &songs, const i64 id, const QString &name,
+		const bool is_active, const i64 generation, quince::ByteArray &ba);
+	
+	i64
+	size() const { return file_.size(); }
+	
+	bool
+	Validate() const;
+	
+	i32
+	version() const;
+
+private:
+	NO_ASSIGN_COPY_MOVE(PlaylistFile);
+	
+	io::MappedFile file_;
+};
+
+}
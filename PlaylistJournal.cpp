@@ -0,0 +1,330 @@
+#include "PlaylistJournal.hpp"
+
+#include "audio/Meta.hpp"
+#include "io/io.hh"
+#include "Song.hpp"
+
+#include <string.h>
+#include <unistd.h>
+
+namespace quince {
+
+static const i64 MinCompactSize = 64 * 1024;
+static const usize EntryHeaderSize = sizeof(u8) + sizeof(u32);
+
+// Of audio::Meta::SaveTo() without tags, up to and with the genre count
+static const usize MetaHeadSize = 1 + 1 + 4 + 8 + 4 + 1 + 1;
+
+// The Skip*() functions check that what's at ba.at() ends before "end"
+// and skip it if so, entries are read only after that.
+static bool
+SkipBytes(quince::ByteArray &ba, const usize end, const usize size)
+{
+	if (ba.at() + size > end)
+		return false;
+	
+	ba.to(ba.at() + size);
+	
+	return true;
+}
+
+static bool
+SkipString(quince::ByteArray &ba, const usize end)
+{
+	if (ba.at() + sizeof(i32) > end)
+		return false;
+	
+	const i32 len = ba.next_i32();
+	
+	return len >= 0 && SkipBytes(ba, end, len);
+}
+
+static bool
+SkipMeta(quince::ByteArray &ba, const usize end)
+{
+	if (!SkipBytes(ba, end, MetaHeadSize - 1))
+		return false;
+	
+	if (ba.at() + sizeof(u8) > end)
+		return false;
+	
+	const usize genre_count = ba.next_u8();
+	
+	return SkipBytes(ba, end, genre_count * sizeof(i16));
+}
+
+static bool
+SkipSong(quince::ByteArray &ba, const usize end, const bool with_file_id)
+{ // see Song::SaveTo(ByteArray&)
+	if (!SkipString(ba, end) || !SkipString(ba, end)) // name, folder
+		return false;
+	
+	// position, state and bits, then after the meta the file id
+	if (!SkipBytes(ba, end, sizeof(i64) + sizeof(i32) + sizeof(u8)) ||
+		!SkipMeta(ba, end))
+		return false;
+	
+	return SkipBytes(ba, end, with_file_id ? sizeof(u64) * 2 : 0);
+}
+
+PlaylistJournal::PlaylistJournal() {}
+PlaylistJournal::~PlaylistJournal() {}
+
+void
+PlaylistJournal::AddEntry(const JournalOp op, quince::ByteArray &payload)
+{
+	pending_.add_u8(u8(op));
+	pending_.add_u32(payload.size());
+	pending_.add(payload.data(), payload.size());
+}
+
+void
+PlaylistJournal::Commit(QByteArray &bytes, bool &create)
+{ // Hands over the pending entries, to be appended to the file
+	create = (size_ == 0);
+	bytes.clear();
+	
+	if (create) {
+		JournalHeader h = {};
+		h.magic = JournalMagic;
+		h.version = JournalVersion;
+		h.generation = generation_;
+		bytes.append(reinterpret_cast<const char*>(&h), sizeof h);
+	}
+	
+	bytes.append(pending_.data(), pending_.size());
+	size_ += bytes.size();
+	pending_.clear();
+	last_remove_at_ = -1;
+}
+
+void
+PlaylistJournal::Insert(const i32 at, const QVector<Song*> &songs)
+{
+	if (songs.isEmpty())
+		return;
+	
+	quince::ByteArray payload;
+	payload.add_i32(at);
+	payload.add_i32(songs.size());
+	
+	for (Song *song: songs)
+		song->SaveTo(payload);
+	
+	AddEntry(JournalOp::Insert, payload);
+	last_remove_at_ = -1;
+}
+
+bool
+PlaylistJournal::must_compact() const
+{
+	if (!in_sync_)
+		return true;
+	
+	const i64 total = size_ + pending_.size();
+	
+	return total > MinCompactSize && total > base_size_ / 4;
+}
+
+void
+PlaylistJournal::Remove(const i32 row, const i32 count)
+{
+	if (count <= 0)
+		return;
+	
+	if (last_remove_at_ != -1)
+	{ // Rows are usually removed one by one from the bottom up,
+		// merge them into a single entry when they're adjacent.
+		char *p = pending_.data() + last_remove_at_ + EntryHeaderSize;
+		i32 last_row, last_count;
+		memcpy(&last_row, p, sizeof last_row);
+		memcpy(&last_count, p + sizeof last_row, sizeof last_count);
+		
+		if (row + count == last_row || row == last_row) {
+			last_row = row;
+			last_count += count;
+			memcpy(p, &last_row, sizeof last_row);
+			memcpy(p + sizeof last_row, &last_count, sizeof last_count);
+			return;
+		}
+	}
+	
+	quince::ByteArray payload;
+	payload.add_i32(row);
+	payload.add_i32(count);
+	last_remove_at_ = pending_.size();
+	AddEntry(JournalOp::Remove, payload);
+}
+
+void
+PlaylistJournal::Rename(const QString &name)
+{
+	quince::ByteArray payload;
+	payload.add_string(name);
+	AddEntry(JournalOp::Rename, payload);
+	last_remove_at_ = -1;
+}
+
+bool
+PlaylistJournal::Replay(const QString &playlist_path, const i64 generation,
+	const i64 playlist_id, QVector<Song*> &songs, QString &name,
+	i64 &journal_size, bool &outdated)
+{
+	journal_size = 0;
+	outdated = false;
+	const QString path = PathFor(playlist_path);
+	auto path_ba = path.toLocal8Bit();
+	
+	if (!io::FileExists(path_ba.data()))
+		return false;
+	
+	quince::ByteArray ba;
+	
+	if (io::ReadFile(path, ba) != io::Err::Ok)
+		return false;
+	
+	const usize total = ba.size(); // reading advances ba.size()
+	JournalHeader h;
+	
+	if (total < sizeof h)
+		return false;
+	
+	ba.next(reinterpret_cast<char*>(&h), sizeof h);
+	
+	const bool with_file_ids = (h.version == JournalVersion);
+	
+	if (h.magic != JournalMagic || (!with_file_ids &&
+		h.version != JournalVersionNoFileIDs) || h.generation != generation)
+		return false; // stale, the next commit starts it over
+	
+	outdated = !with_file_ids;
+	
+	while (ba.at() + EntryHeaderSize <= total)
+	{
+		const usize entry_at = ba.at();
+		const JournalOp op = JournalOp(ba.next_u8());
+		const u32 size = ba.next_u32();
+		
+		if (ba.at() + size > total) {
+			ba.to(entry_at);
+			break; // partially written
+		}
+		
+		const usize next_entry = ba.at() + size;
+		
+		if ((op == JournalOp::Insert || op == JournalOp::Remove) &&
+			ba.at() + sizeof(i32) * 2 > next_entry) {
+			mtl_warn("Invalid journal entry: %d", int(op));
+		} else if (op == JournalOp::Insert) {
+			i32 at = ba.next_i32();
+			const i32 count = ba.next_i32();
+			
+			if (at < 0 || at > songs.size())
+				at = songs.size();
+			
+			for (i32 i = 0; i < count; i++)
+			{
+				const usize song_at = ba.at();
+				
+				if (!SkipSong(ba, next_entry, with_file_ids)) {
+					mtl_warn("Invalid song in insert entry");
+					break;
+				}
+				
+				ba.to(song_at);
+				songs.insert(at + i, Song::From(ba, playlist_id, with_file_ids));
+			}
+		} else if (op == JournalOp::Remove) {
+			const i32 row = ba.next_i32();
+			const i32 count = ba.next_i32();
+			
+			if (row >= 0 && count > 0 && count <= songs.size() - row)
+			{
+				for (i32 i = row; i < row + count; i++)
+					delete songs[i];
+				
+				songs.remove(row, count);
+			} else {
+				mtl_warn("Invalid remove: %d, %d", row, count);
+			}
+		} else if (op == JournalOp::Rename) {
+			const usize name_at = ba.at();
+			
+			if (SkipString(ba, next_entry)) {
+				ba.to(name_at);
+				name = ba.next_string();
+			} else {
+				mtl_warn("Invalid rename entry");
+			}
+		} else if (op == JournalOp::Update) {
+			const i32 count = (ba.at() + sizeof(i32) <= next_entry) ?
+				ba.next_i32() : 0;
+			
+			for (i32 i = 0; i < count; i++)
+			{
+				if (ba.at() + sizeof(i32) > next_entry)
+					break;
+				
+				const i32 row = ba.next_i32();
+				const usize meta_at = ba.at();
+				
+				if (!SkipMeta(ba, next_entry)) {
+					mtl_warn("Invalid meta in update entry");
+					break;
+				}
+				
+				if (row >= 0 && row < songs.size()) {
+					ba.to(meta_at);
+					songs[row]->meta().Read(ba, false);
+				}
+			}
+		} else {
+			mtl_warn("Unknown journal op: %d", int(op));
+		}
+		
+		ba.to(next_entry);
+	}
+	
+	journal_size = ba.at();
+	
+	if (journal_size < i64(total)) {
+		// Drop the partial entry so that new ones don't end up after it
+		if (truncate(path_ba.data(), journal_size) != 0)
+			journal_size = -1;
+	}
+	
+	return true;
+}
+
+void
+PlaylistJournal::Restart(const i64 generation, const i64 base_size,
+	const i64 journal_size)
+{
+	generation_ = generation;
+	base_size_ = base_size;
+	size_ = (journal_size > 0) ? journal_size : 0;
+	pending_.clear();
+	last_remove_at_ = -1;
+	in_sync_ = (journal_size >= 0);
+}
+
+void
+PlaylistJournal::Update(const QVector<i32> &rows, const QVector<Song*> &songs)
+{
+	if (songs.isEmpty())
+		return;
+	
+	quince::ByteArray payload;
+	payload.add_i32(songs.size());
+	
+	for (i32 i = 0; i < songs.size(); i++)
+	{
+		payload.add_i32(rows[i]);
+		songs[i]->meta().SaveTo(payload, false);
+	}
+	
+	AddEntry(JournalOp::Update, payload);
+	last_remove_at_ = -1;
+}
+
+}
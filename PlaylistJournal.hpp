@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ByteArray.hpp"
+#include "decl.hxx"
+#include "err.hpp"
+#include "types.hxx"
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+namespace quince {
+
+/* Edits to a playlist get appended to "<playlist file>.journal" instead
+ of rewriting the whole playlist file, so that saving an edit costs about
+ as much as the edit itself. Once the journal grows too big relative to
+ the playlist file the playlist is saved in full (compacted).
+ The journal starts with a JournalHeader whose generation must match the
+ one in the playlist file, otherwise the journal predates the last full
+ save and is ignored. Then follow the entries: u8 op | u32 size | payload */
+
+static const u32 JournalMagic = 0x4A4C5051; // "QPLJ"
+static const i32 JournalVersion = 3;
+static const i32 JournalVersionNoFileIDs = 2; // still replayed
+
+struct JournalHeader {
+	u32 magic;
+	i32 version;
+	i64 generation;
+};
+
+enum class JournalOp: u8 {
+	Insert = 1, // i32 at | i32 count | songs
+	Remove, // i32 row | i32 count
+	Rename, // string
+	Update, // i32 count | (i32 row | meta without tags) * count
+};
+
+class PlaylistJournal {
+public:
+	PlaylistJournal();
+	virtual ~PlaylistJournal();
+	
+	void
+	Commit(QByteArray &bytes, bool &create);
+	
+	i64
+	generation() const { return generation_; }
+	
+	bool
+	has_pending() const { return pending_.size() > 0; }
+	
+	void
+	Insert(const i32 at, const QVector<Song*> &songs);
+	
+	void
+	Invalidate() { in_sync_ = false; }
+	
+	bool
+	must_compact() const;
+	
+	static QString
+	PathFor(const QString &playlist_path) {
+		return playlist_path + QLatin1String(".journal");
+	}
+	
+	void
+	Remove(const i32 row, const i32 count);
+	
+	void
+	Rename(const QString &name);
+	
+	// journal_size is set to -1 if the journal can't be appended to,
+	// outdated is set if it was written in an older version.
+	static bool
+	Replay(const QString &playlist_path, const i64 generation,
+		const i64 playlist_id, QVector<Song*> &songs, QString &name,
+		i64 &journal_size, bool &outdated);
+	
+	void
+	Restart(const i64 generation, const i64 base_size, const i64 journal_size = 0);
+	
+	// The songs' metadata changed, rows[i] is the row of songs[i]
+	void
+	Update(const QVector<i32> &rows, const QVector<Song*> &songs);
+
+private:
+	NO_ASSIGN_COPY_MOVE(PlaylistJournal);
+	
+	void
+	AddEntry(const JournalOp op, quince::ByteArray &payload);
+	
+	quince::ByteArray pending_;
+	i64 generation_ = 0;
+	i64 base_size_ = 0; // size of the playlist file
+	i64 size_ = 0; // on disk, 0 if it must be (re)created
+	i64 last_remove_at_ = -1; // offset of the last pending Remove entry
+	bool in_sync_ = false; // whether the playlist file can be appended to
+};
+
+}
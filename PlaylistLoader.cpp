@@ -0,0 +1,233 @@
+#include "PlaylistLoader.hpp"
+
+#include "App.hpp"
+#include "PlaylistFile.hpp"
+#include "PlaylistJournal.hpp"
+#include "Song.hpp"
+
+#include <algorithm>
+#include <sys/stat.h>
+
+namespace quince {
+
+static const unsigned MaxWorkers = 4;
+
+PlaylistLoader::PlaylistLoader(App *app) : app_(app) {}
+
+PlaylistLoader::~PlaylistLoader()
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		stop_ = true;
+	}
+	
+	jobs_cv_.notify_all();
+	
+	for (std::thread &t: workers_)
+		t.join();
+	
+	for (load::Job &job: jobs_)
+		delete job.file;
+	
+	for (load::Result &result: results_)
+	{
+		for (Song *song: result.songs)
+			delete song;
+		
+		delete result.file;
+	}
+}
+
+void
+PlaylistLoader::Add(const i64 id, const QString &full_path, PlaylistFile *file)
+{
+	load::Job job;
+	job.id = id;
+	job.full_path = full_path;
+	job.file = file;
+	
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		jobs_.push_back(job);
+	}
+	
+	jobs_cv_.notify_one();
+}
+
+void
+PlaylistLoader::Cancel(const i64 id)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	
+	for (auto it = jobs_.begin(); it != jobs_.end(); it++)
+	{
+		if (it->id == id) {
+			delete it->file;
+			jobs_.erase(it);
+			return;
+		}
+	}
+	
+	done_cv_.wait(lock, [this, id] { return running_.count(id) == 0; });
+	
+	for (auto it = results_.begin(); it != results_.end(); it++)
+	{
+		if (it->id == id) {
+			for (Song *song: it->songs)
+				delete song;
+			
+			delete it->file;
+			results_.erase(it);
+			return;
+		}
+	}
+}
+
+void
+PlaylistLoader::DeliverResults()
+{
+	std::vector<load::Result> results;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		results.swap(results_);
+		results_scheduled_ = false;
+	}
+	
+	for (load::Result &result: results)
+		app_->PlaylistLoaded(result);
+}
+
+void
+PlaylistLoader::Load(const i64 id)
+{
+	load::Job job;
+	bool found = false;
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		
+		for (auto it = jobs_.begin(); it != jobs_.end(); it++)
+		{
+			if (it->id == id) {
+				job = *it;
+				jobs_.erase(it);
+				found = true;
+				break;
+			}
+		}
+		
+		if (!found)
+			done_cv_.wait(lock, [this, id] { return running_.count(id) == 0; });
+	}
+	
+	if (found) {
+		load::Result result;
+		Run(job, result);
+		app_->PlaylistLoaded(result);
+	}
+	
+	// If a worker got to it first it's among the results
+	DeliverResults();
+}
+
+void
+PlaylistLoader::Loop()
+{
+	while (true)
+	{
+		load::Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			jobs_cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+			
+			if (stop_)
+				return;
+			
+			job = jobs_.front();
+			jobs_.pop_front();
+			running_.insert(job.id);
+		}
+		
+		load::Result result;
+		Run(job, result);
+		bool schedule = false;
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			running_.erase(job.id);
+			results_.push_back(result);
+			
+			if (!results_scheduled_) {
+				results_scheduled_ = true;
+				schedule = true;
+			}
+		}
+		
+		done_cv_.notify_all();
+		
+		if (schedule) {
+			QMetaObject::invokeMethod(app_, [this] {
+				DeliverResults();
+			}, Qt::QueuedConnection);
+		}
+	}
+}
+
+void
+PlaylistLoader::Run(load::Job &job, load::Result &result)
+{
+	PlaylistFile *file = job.file;
+	const PlaylistHeader *header = file->header();
+	result.id = job.id;
+	result.file = file;
+	result.name = file->name();
+	result.generation = header->generation;
+	const i32 song_count = header->song_count;
+	result.songs.reserve(song_count);
+	std::vector<u32> dir_ids;
+	file->InternDirs(dir_ids);
+	
+	// Only the fixed-width records are read here, the file names stay
+	// in the mapped file until a row gets displayed or played.
+	for (i32 i = 0; i < song_count; i++)
+	{
+		const SongRecord *record = file->record(i);
+		
+		if (file->RecordIsValid(record)) {
+			result.songs.append(Song::From(record, job.id,
+				dir_ids[record->dir_index], file->has_file_ids()));
+		}
+	}
+	
+	bool journal_outdated;
+	PlaylistJournal::Replay(job.full_path, result.generation, job.id,
+		result.songs, result.name, result.journal_size, journal_outdated);
+	result.outdated = journal_outdated || !file->has_file_ids();
+	
+	if (!result.outdated)
+		return;
+	
+	// Once, the ids get stored when the playlist is saved again
+	struct stat st;
+	
+	for (Song *song: result.songs)
+	{
+		if (song->file_id().Initialized())
+			continue;
+		
+		auto path_ba = song->full_path().toLocal8Bit();
+		
+		if (stat(path_ba.data(), &st) == 0)
+			song->file_id(io::FileID {.device_id = st.st_dev, .inode_number = st.st_ino});
+	}
+}
+
+void
+PlaylistLoader::Start()
+{
+	const unsigned cores = std::thread::hardware_concurrency();
+	const unsigned worker_count = std::max(1u, std::min(cores, MaxWorkers));
+	
+	for (unsigned i = 0; i < worker_count; i++)
+		workers_.emplace_back(&PlaylistLoader::Loop, this);
+}
+
+}
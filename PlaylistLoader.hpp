@@ -0,0 +1,72 @@
+#pragma once
+
+#include "decl.hxx"
+#include "err.hpp"
+#include "types.hxx"
+
+#include <QString>
+#include <QVector>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace quince {
+
+namespace load {
+
+struct Job {
+	i64 id = -1;
+	QString full_path;
+	PlaylistFile *file = nullptr;
+};
+
+struct Result {
+	i64 id = -1;
+	PlaylistFile *file = nullptr;
+	QVector<Song*> songs;
+	QString name;
+	i64 generation = 0;
+	i64 journal_size = 0;
+	bool outdated = false; // saved without file ids, must be saved again
+};
+
+}
+
+/* At startup only the playlist headers are read on the GUI thread. The
+ songs of each playlist get created from its (mapped) file and journal
+ on worker threads, or right away once the playlist is needed, and then
+ handed over to the GUI thread. */
+class PlaylistLoader {
+public:
+	PlaylistLoader(App *app);
+	virtual ~PlaylistLoader();
+	
+	void Add(const i64 id, const QString &full_path, PlaylistFile *file);
+	void Cancel(const i64 id);
+	void Load(const i64 id);
+	void Start();
+
+private:
+	NO_ASSIGN_COPY_MOVE(PlaylistLoader);
+	
+	void DeliverResults();
+	void Loop();
+	static void Run(load::Job &job, load::Result &result);
+	
+	App *app_ = nullptr;
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable jobs_cv_;
+	std::condition_variable done_cv_;
+	std::deque<load::Job> jobs_;
+	std::unordered_set<i64> running_;
+	std::vector<load::Result> results_;
+	bool results_scheduled_ = false;
+	bool stop_ = false;
+};
+
+}
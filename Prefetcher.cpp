@@ -0,0 +1,145 @@
+#include "Prefetcher.hpp"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace quince {
+
+Prefetcher::Prefetcher(const i64 budget) : budget_(budget)
+{
+	thread_ = std::thread(&Prefetcher::Loop, this);
+}
+
+Prefetcher::~Prefetcher()
+{
+	if (hits_ + late_ + misses_ > 0) {
+		mtl_info("Prefetch: %ld hits, %ld late, %ld misses, %ld%% cached already",
+			hits_, late_, misses_, cached_percent_sum_ / std::max(hits_, i64(1)));
+	}
+	
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		stop_ = true;
+	}
+	
+	cv_.notify_one();
+	thread_.join();
+}
+
+int
+Prefetcher::Fetch(const QByteArray &path)
+{ // returns how much of it was cached already, in percent, or -1
+	const int fd = open(path.constData(), O_RDONLY | O_CLOEXEC);
+	
+	if (fd == -1)
+		return -1;
+	
+	struct stat st;
+	
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return -1;
+	}
+	
+	const usize len = std::min(i64(st.st_size), budget_);
+	const usize page_size = sysconf(_SC_PAGESIZE);
+	const usize pages = (len + page_size - 1) / page_size;
+	int cached_percent = -1;
+	void *addr = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+	
+	if (addr != MAP_FAILED) {
+		std::vector<unsigned char> residency(pages);
+		
+		if (mincore(addr, len, residency.data()) == 0) {
+			const usize cached = std::count_if(residency.begin(), residency.end(),
+				[] (const unsigned char c) { return (c & 1) != 0; });
+			cached_percent = cached * 100 / pages;
+		}
+		
+		munmap(addr, len);
+	}
+	
+	if (cached_percent != 100) {
+		posix_fadvise(fd, 0, len, POSIX_FADV_WILLNEED);
+		readahead(fd, 0, len); // waits for the reads, unlike fadvise
+	}
+	
+	close(fd);
+	
+	return cached_percent;
+}
+
+void
+Prefetcher::Loop()
+{
+	while (true)
+	{
+		QByteArray path;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [this] { return stop_ || !pending_.isEmpty(); });
+			
+			if (stop_)
+				return;
+			
+			path = pending_;
+			pending_.clear();
+		}
+		
+		const int cached_percent = Fetch(path);
+		
+		std::lock_guard<std::mutex> guard(mutex_);
+		fetched_ = path;
+		cached_percent_ = cached_percent;
+	}
+}
+
+void
+Prefetcher::Request(const QByteArray &path)
+{
+	if (budget_ <= 0)
+		return;
+	
+	requested_ = path;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		pending_ = path;
+	}
+	
+	cv_.notify_one();
+}
+
+void
+Prefetcher::Started(const QByteArray &path)
+{
+	if (requested_.isEmpty())
+		return; // nothing was read ahead for it
+	
+	bool done;
+	int cached_percent;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		done = fetched_ == requested_;
+		cached_percent = done ? cached_percent_ : -1;
+		
+		if (!done)
+			pending_.clear(); // too late to help
+	}
+	
+	if (path != requested_) {
+		misses_++; // another song started
+	} else if (!done) {
+		late_++; // still reading
+	} else {
+		hits_++;
+		cached_percent_sum_ += std::max(cached_percent, 0);
+	}
+	
+	requested_.clear();
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "decl.hxx"
+#include "err.hpp"
+#include "types.hxx"
+
+#include <QByteArray>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace quince {
+
+/* Reads the start of the song that's going to play next into the page
+ cache while the current one is still playing, so slow storage (USB
+ disks, NFS, a disk that spun down) doesn't make the next song stutter
+ or start late. At most budget bytes of each file are read ahead, on
+ its own thread. Whether the song that actually started next was the
+ one read ahead, and how much of it was cached already anyway, is
+ counted and logged at exit to tune the budget and the lead time. */
+class Prefetcher {
+public:
+	Prefetcher(const i64 budget);
+	virtual ~Prefetcher();
+	
+	// Replaces a request that didn't start yet
+	void
+	Request(const QByteArray &path);
+	
+	// A song started playing, reports on the last request
+	void
+	Started(const QByteArray &path);
+
+private:
+	NO_ASSIGN_COPY_MOVE(Prefetcher);
+	
+	int Fetch(const QByteArray &path);
+	void Loop();
+	
+	const i64 budget_;
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	QByteArray pending_;
+	QByteArray fetched_; // the last one done
+	int cached_percent_ = -1; // of fetched_, before reading it ahead
+	bool stop_ = false;
+	
+	// GUI thread only:
+	QByteArray requested_;
+	i64 hits_ = 0;
+	i64 late_ = 0;
+	i64 misses_ = 0;
+	i64 cached_percent_sum_ = 0; // of the hits
+};
+
+}
@@ -0,0 +1,181 @@
+#include "Resumer.hpp"
+
+#include "App.hpp"
+#include "audio.hh"
+#include "ByteArray.hpp"
+#include "GstPlayer.hpp"
+#include "io/io.hh"
+
+namespace quince {
+
+static const i32 ResumeFileVersion = 1;
+
+// Each state change gets this long, the file might be on a sleeping disk
+static const GstClockTime StateTimeout = 5 * GST_SECOND;
+
+// How often a state change being waited for checks if it's still wanted
+static const GstClockTime StatePollStep = 100 * GST_MSECOND;
+
+static i64
+ms_since(timespec &start)
+{
+	timespec now, diff;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	audio::timespec_diff(&start, &now, &diff);
+	
+	return diff.tv_sec * 1000L + diff.tv_nsec / 1000000L;
+}
+
+Resumer::Resumer(GstPlayer *player) : player_(player)
+{
+	clock_gettime(CLOCK_MONOTONIC_RAW, &started_);
+	QString path;
+	
+	if (QueryPath(path))
+		thread_ = std::thread(&Resumer::Run, this, path);
+	else
+		done_ = true;
+}
+
+Resumer::~Resumer()
+{
+	abandoned_ = true;
+	
+	if (thread_.joinable())
+		thread_.join();
+	
+	if (elem_ != nullptr)
+		player_->DeletePlaybin(elem_);
+}
+
+bool
+Resumer::QueryPath(QString &path)
+{
+	QString dir_path;
+	CHECK_TRUE(App::QueryAppConfigPath(dir_path));
+	path = dir_path + QLatin1String("/resume");
+	
+	return true;
+}
+
+void
+Resumer::Preroll(const QString &path)
+{
+	ByteArray ba;
+	
+	if (io::ReadFile(path, ba) != io::Err::Ok || ba.size() < sizeof(i32))
+		return;
+	
+	const usize total = ba.size(); // next_*() grows size()
+	
+	if (ba.next_i32() != ResumeFileVersion)
+		return;
+	
+	const usize uri_at = ba.at();
+	
+	if (total < uri_at + sizeof(i32) + sizeof(i64))
+		return;
+	
+	const i32 uri_len = ba.next_i32();
+	ba.to(uri_at);
+	
+	if (uri_len <= 0 || total != uri_at + sizeof(i32) + uri_len + sizeof(i64))
+		return;
+	
+	const QByteArray uri = ba.next_string().toLocal8Bit();
+	const i64 position = ba.next_i64();
+	GstElement *elem = player_->NewPlaybin();
+	g_object_set(G_OBJECT(elem), "uri", uri.constData(), NULL);
+	
+	// playbin can't start at a position, so preroll then seek
+	gst_element_set_state(elem, GST_STATE_PAUSED);
+	bool ok = WaitForState(elem);
+	
+	if (ok && position > 0) {
+		auto flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE;
+		ok = gst_element_seek_simple(elem, GST_FORMAT_TIME,
+			GstSeekFlags(flags), position) && WaitForState(elem);
+	}
+	
+	elem_ = elem;
+	uri_ = uri;
+	position_ = position;
+	ready_ = ok;
+	
+	if (ok)
+		mtl_info("Resume point ready %ld ms after launch", ms_since(started_));
+}
+
+void
+Resumer::Run(const QString &path)
+{
+	Preroll(path);
+	done_ = true;
+}
+
+bool
+Resumer::WaitForState(GstElement *elem)
+{ // in steps, to stop waiting soon once the GUI went on without it
+	GstClockTime waited = 0;
+	
+	while (!abandoned_ && waited < StateTimeout) {
+		auto ret = gst_element_get_state(elem, nullptr, nullptr, StatePollStep);
+		
+		if (ret != GST_STATE_CHANGE_ASYNC)
+			return ret == GST_STATE_CHANGE_SUCCESS;
+		
+		waited += StatePollStep;
+	}
+	
+	return false;
+}
+
+bool
+Resumer::Save(const QString &uri, const i64 position)
+{
+	QString path;
+	CHECK_TRUE(QueryPath(path));
+	
+	if (uri.isEmpty() || position < 0) {
+		auto ba = path.toLocal8Bit();
+		remove(ba.data());
+		return true;
+	}
+	
+	ByteArray ba;
+	ba.add_i32(ResumeFileVersion);
+	ba.add_string(uri);
+	ba.add_i64(position);
+	
+	return io::ReplaceFile(path, ba.data(), ba.size()) == io::Err::Ok;
+}
+
+GstElement*
+Resumer::Take(const QByteArray &uri, const i64 position)
+{
+	if (taken_)
+		return nullptr;
+	
+	taken_ = true;
+	
+	if (!done_)
+	{ // don't make the GUI wait, it prerolls the song itself
+		abandoned_ = true;
+		mtl_info("Resume point not ready %ld ms after launch", ms_since(started_));
+		return nullptr;
+	}
+	
+	if (thread_.joinable())
+		thread_.join(); // returns at once, it's done
+	
+	if (elem_ == nullptr || !ready_ || uri != uri_ || position != position_)
+		return nullptr;
+	
+	GstElement *elem = elem_;
+	elem_ = nullptr;
+	mtl_info("Resumed %ld ms after launch", ms_since(started_));
+	
+	return elem;
+}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "decl.hxx"
+#include "err.hpp"
+#include "types.hxx"
+
+#include <gst/gst.h>
+
+#include <QByteArray>
+#include <QString>
+
+#include <atomic>
+#include <thread>
+#include <time.h>
+
+namespace quince {
+
+/* Gets the song that was paused when the app quit ready to play again
+ while the GUI is still being built. The song's uri and position are
+ saved to a small file at exit, so at startup a thread can preroll a
+ playbin and seek it to the saved spot long before the playlists are
+ loaded and the GUI knows which song it is. The GUI then takes the
+ pipeline as it is instead of prerolling and seeking its own. */
+class Resumer {
+public:
+	Resumer(GstPlayer *player);
+	virtual ~Resumer();
+	
+	static bool
+	Save(const QString &uri, const i64 position);
+	
+	// The pipeline paused at position in uri or nullptr, the caller owns it.
+	// Doesn't wait for the thread, nullptr if it isn't done yet.
+	GstElement*
+	Take(const QByteArray &uri, const i64 position);
+	
+	bool
+	done() const { return done_; }
+
+private:
+	NO_ASSIGN_COPY_MOVE(Resumer);
+	
+	static bool QueryPath(QString &path);
+	void Preroll(const QString &path);
+	void Run(const QString &path);
+	bool WaitForState(GstElement *elem);
+	
+	GstPlayer *player_ = nullptr;
+	std::thread thread_;
+	timespec started_ = {}; // when the app started
+	std::atomic<bool> done_ {false};
+	std::atomic<bool> abandoned_ {false}; // the GUI went on without it
+	bool taken_ = false;
+	
+	// Set by the thread:
+	GstElement *elem_ = nullptr;
+	QByteArray uri_;
+	i64 position_ = -1;
+	bool ready_ = false;
+};
+
+}
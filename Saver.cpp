@@ -0,0 +1,159 @@
+#include "Saver.hpp"
+
+#include "App.hpp"
+#include "io/io.hh"
+#include "PlaylistJournal.hpp"
+
+namespace quince {
+
+Saver::Saver(App *app) : app_(app)
+{
+	thread_ = std::thread(&Saver::Loop, this);
+}
+
+Saver::~Saver()
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		stop_ = true;
+	}
+	
+	cv_.notify_one();
+	thread_.join();
+}
+
+void
+Saver::Append(const i64 id, const QString &path, const QByteArray &bytes,
+	const bool truncate)
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		save::Job &job = GetJob(id);
+		job.path = path;
+		
+		if (truncate) {
+			job.journal = bytes;
+			job.truncate_journal = true;
+		} else {
+			job.journal.append(bytes);
+		}
+	}
+	
+	cv_.notify_one();
+}
+
+void
+Saver::Cancel(const i64 id)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	
+	if (pending_.erase(id) > 0) {
+		for (auto it = order_.begin(); it != order_.end(); it++) {
+			if (*it == id) {
+				order_.erase(it);
+				break;
+			}
+		}
+	}
+	
+	// Let a write that's already in progress finish
+	done_cv_.wait(lock, [this, id] { return writing_ != id; });
+}
+
+save::Job&
+Saver::GetJob(const i64 id)
+{
+	auto it = pending_.find(id);
+	
+	if (it != pending_.end())
+		return it->second;
+	
+	order_.push_back(id);
+	
+	return pending_[id];
+}
+
+void
+Saver::Loop()
+{
+	while (true)
+	{
+		i64 id;
+		save::Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [this] { return stop_ || !order_.empty(); });
+			
+			if (order_.empty())
+				return; // stopping and nothing left to write
+			
+			id = order_.front();
+			order_.pop_front();
+			auto it = pending_.find(id);
+			job = std::move(it->second);
+			pending_.erase(it);
+			writing_ = id;
+		}
+		
+		const bool ok = Write(job);
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			writing_ = -1;
+		}
+		
+		done_cv_.notify_all();
+		
+		if (!ok) {
+			QMetaObject::invokeMethod(app_, [this, id] {
+				app_->PlaylistSaveFailed(id);
+			}, Qt::QueuedConnection);
+		}
+	}
+}
+
+void
+Saver::Replace(const i64 id, const QString &path, const QByteArray &bytes)
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		save::Job &job = GetJob(id);
+		job.path = path;
+		job.snapshot = bytes;
+		job.has_snapshot = true;
+		// The snapshot has all of the journaled edits so far, what's
+		// appended after this starts the journal over anyway.
+		job.journal.clear();
+		job.truncate_journal = false;
+	}
+	
+	cv_.notify_one();
+}
+
+bool
+Saver::Write(save::Job &job)
+{
+	if (job.has_snapshot) {
+		if (io::ReplaceFile(job.path, job.snapshot.data(),
+			job.snapshot.size()) != io::Err::Ok) {
+			auto ba = job.path.toLocal8Bit();
+			mtl_warn("Failed to save playlist: %s", ba.data());
+			return false;
+		}
+	}
+	
+	if (job.journal.isEmpty())
+		return true;
+	
+	const QString journal_path = PlaylistJournal::PathFor(job.path);
+	
+	if (io::AppendToFile(journal_path, job.journal.data(), job.journal.size(),
+		job.truncate_journal, true) != io::Err::Ok) {
+		auto ba = journal_path.toLocal8Bit();
+		mtl_warn("Failed to append to journal: %s", ba.data());
+		return false;
+	}
+	
+	return true;
+}
+
+}
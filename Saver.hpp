@@ -0,0 +1,68 @@
+#pragma once
+
+#include "decl.hxx"
+#include "err.hpp"
+#include "types.hxx"
+
+#include <QByteArray>
+#include <QString>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace quince {
+
+namespace save {
+
+struct Job {
+	QString path; // of the playlist file
+	QByteArray snapshot; // the whole playlist file
+	QByteArray journal; // to be appended to the playlist's journal
+	bool has_snapshot = false;
+	bool truncate_journal = false;
+};
+
+}
+
+/* Writes playlists to disk on its own thread. The GUI thread serializes
+ a playlist (or its journal entries) and hands over the bytes; requests
+ for a playlist that's still waiting to be written are merged into one.
+ Playlist files are replaced through a temporary file which is fsync()ed
+ before being renamed into place. */
+class Saver {
+public:
+	Saver(App *app);
+	virtual ~Saver(); // writes whatever is still pending
+	
+	void
+	Append(const i64 id, const QString &path, const QByteArray &bytes,
+		const bool truncate);
+	
+	void
+	Cancel(const i64 id);
+	
+	void
+	Replace(const i64 id, const QString &path, const QByteArray &bytes);
+
+private:
+	NO_ASSIGN_COPY_MOVE(Saver);
+	
+	save::Job& GetJob(const i64 id);
+	void Loop();
+	bool Write(save::Job &job);
+	
+	App *app_ = nullptr;
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::condition_variable done_cv_;
+	std::unordered_map<i64, save::Job> pending_;
+	std::deque<i64> order_;
+	i64 writing_ = -1;
+	bool stop_ = false;
+};
+
+}
@@ -1,11 +1,15 @@
 #include "Song.hpp"
 
+#include "audio.hh"
 #include "audio/TempSongInfo.hpp"
 #include "ByteArray.hpp"
 #include "io/File.hpp"
+#include "PlaylistFile.hpp"
 
 #include <QUrl>
 
+#include <string.h>
+
 namespace quince {
 
 void
@@ -17,110 +21,203 @@ Song::Apply(const audio::Info &info)
 	meta_.duration(info.duration);
 }
 
+const QString&
+Song::filename() const
+{
+	if (!filename_decoded_) {
+		filename_ = QString::fromLocal8Bit(record_->heap() +
+			record_->filename_offset, record_->filename_len);
+		filename_decoded_ = true;
+	}
+	
+	return filename_;
+}
+
 void
 Song::FillIn(audio::TempSongInfo &info)
 {
 	info.duration = meta_.duration();
 	info.song = this;
-	info.uri = uri_;
 	info.position = position_;
 	info.playlist_id = playlist_id_;
 	info.state_ = state_;
 }
 
 Song*
-Song::From(quince::ByteArray &ba, const i64 playlist_id)
-{
+Song::From(quince::ByteArray &ba, const i64 playlist_id,
+	const bool with_file_id)
+{ // the counterpart of SaveTo(ByteArray&)
 	Song *song = new Song();
-	song->display_name(ba.next_string());
-	song->uri(ba.next_string());
-	song->dir_path(ba.next_string());
+	song->filename(ba.next_string());
+	song->dir_id(dirs::Intern(ba.next_string()));
 	song->position(ba.next_i64());
 	song->playlist_id(playlist_id);
 	song->state(GstState(ba.next_i32()));
 	song->bits() = ba.next_u8();
 	
-	audio::Meta &meta = song->meta();
-	meta.channels(ba.next_i8());
-	meta.bits_per_sample(ba.next_i8());
-	meta.sample_rate(ba.next_i32());
-	meta.duration(ba.next_i64());
-	meta.bitrate(ba.next_i32());
-	meta.audio_codec(audio::Codec(ba.next_u8()));
-	
-	const u8 count = ba.next_u8();
-	auto &vec = meta.genres();
-	
-	for (u8 i = 0; i < count; i++) {
-		vec.append(audio::Genre(ba.next_i16()));
+	song->meta().Read(ba, false);
+	
+	if (with_file_id) {
+		song->file_id_.device_id = dev_t(ba.next_u64());
+		song->file_id_.inode_number = ino_t(ba.next_u64());
 	}
 	
 	return song;
 }
 
 Song*
-Song::FromFile(const io::File &file, const i64 playlist_id)
+Song::From(const SongRecord *record, const i64 playlist_id, const u32 dir_id,
+	const bool with_file_id)
 {
-	QStringRef ext = file.Extension();
+	Song *song = new Song();
+	song->record_ = record;
+	song->filename_decoded_ = false;
+	song->dir_id(dir_id);
 	
-	if (ext.isNull()) {
-//		mtl_info("file extension is null");
-		return nullptr;
+	if (with_file_id) {
+		song->file_id_.device_id = dev_t(record->device_id);
+		song->file_id_.inode_number = ino_t(record->inode_number);
+	}
+	
+	song->position(record->position);
+	song->playlist_id(playlist_id);
+	song->state(GstState(record->state));
+	song->bits() = record->bits;
+	
+	audio::Meta &meta = song->meta();
+	meta.channels(record->channels);
+	meta.bits_per_sample(record->bits_per_sample);
+	meta.sample_rate(record->sample_rate);
+	meta.duration(record->duration);
+	meta.bitrate(record->bitrate);
+	meta.audio_codec(audio::Codec(record->codec));
+	
+	const u8 count = record->genre_count;
+	
+	if (count > 0)
+	{
+		auto &vec = meta.genres();
+		vec.reserve(count);
+		const char *p = record->heap() + record->genres_offset;
+		
+		for (u8 i = 0; i < count; i++) {
+			i16 n;
+			memcpy(&n, p + i * sizeof n, sizeof n);
+			vec.append(audio::Genre(n));
+		}
 	}
 	
-	QString lower = ext.toString().toLower();
-	audio::Codec audio_codec = audio::Codec::Unknown;
-	
-	if (lower == QLatin1String("mp3"))
-		audio_codec = audio::Codec::Mp3;
-	else if (lower == QLatin1String("flac"))
-		audio_codec = audio::Codec::Flac;
-	else if (lower == QLatin1String("opus"))
-		audio_codec = audio::Codec::OggOpus;
-	else if (lower == QLatin1String("mka"))
-		audio_codec = audio::Codec::Mka;
-	else
+	return song;
+}
+
+Song*
+Song::FromFile(const io::File &file, const i64 playlist_id)
+{
+	const audio::Codec audio_codec = audio::CodecFromFileName(file.name);
+	
+	if (audio_codec == audio::Codec::Unknown)
 		return nullptr;
 	
 	auto *song = new Song();
-	song->display_name(file.name);
+	song->filename(file.name);
 	song->playlist_id(playlist_id);
-	song->dir_path(file.dir_path);
+	song->dir_id(dirs::Intern(file.dir_path));
+	song->file_id(file.id);
 	
 	audio::Meta &meta = song->meta();
 	meta.audio_codec(audio_codec);
 	
-	QString uri_path = QLatin1String("file://") + file.build_full_path();
-	song->uri(QUrl(uri_path).toEncoded());
+	return song;
+}
+
+Song*
+Song::FromLegacy(quince::ByteArray &ba, const i64 playlist_id)
+{ // playlist cache version 3, the display name was the file name
+	Song *song = new Song();
+	song->filename(ba.next_string());
+	ba.next_string(); // uri
+	song->dir_id(dirs::Intern(ba.next_string()));
+	song->position(ba.next_i64());
+	song->playlist_id(playlist_id);
+	song->state(GstState(ba.next_i32()));
+	song->bits() = ba.next_u8();
+	
+	song->meta().Read(ba, false);
 	
 	return song;
 }
 
-void
-Song::SaveTo(quince::ByteArray &ba)
+QString
+Song::full_path() const
 {
-	ba.add_string(display_name_);
-	ba.add_string(uri_);
-	ba.add_string(dir_path_);
+	QString path = dir_path();
+	
+	if (!path.endsWith('/'))
+		path.append('/');
+	
+	return path + filename();
+}
+
+void
+Song::SaveTo(quince::ByteArray &ba) const
+{ // the counterpart of From(ByteArray&)
+	ba.add_string(filename());
+	ba.add_string(dir_path());
 	ba.add_i64(position_);
-	GstState state = is_playing() ? GST_STATE_PAUSED : state_;
+	const GstState state = is_playing() ? GST_STATE_PAUSED : state_;
 	ba.add_i32(i32(state));
 	ba.add_u8(bits_);
+	meta_.SaveTo(ba, false);
+	ba.add_u64(u64(file_id_.device_id));
+	ba.add_u64(u64(file_id_.inode_number));
+}
+
+void
+Song::SaveTo(SongRecord &record, quince::ByteArray &heap,
+	const u32 dir_index) const
+{
+	record.filename_offset = heap.size();
 	
-	// now add audio::Meta
-	ba.add_i8(meta_.channels());
-	ba.add_i8(meta_.bits_per_sample());
-	ba.add_i32(meta_.sample_rate());
-	ba.add_i64(meta_.duration());
-	ba.add_i32(meta_.bitrate());
-	ba.add_u8(u8(meta_.audio_codec()));
+	if (filename_decoded_) {
+		auto ba = filename_.toLocal8Bit();
+		record.filename_len = ba.size();
+		heap.add(ba.data(), ba.size());
+	} else { // never decoded, copy the bytes as they are
+		record.filename_len = record_->filename_len;
+		heap.add(record_->heap() + record_->filename_offset,
+			record_->filename_len);
+	}
 	
-	auto &vec = meta_.genres();
-	const u8 count = vec.size();
-	ba.add_u8(count);
+	record.dir_index = dir_index;
+	record.position = position_;
+	GstState state = is_playing() ? GST_STATE_PAUSED : state_;
+	record.state = i32(state);
+	record.bits = bits_;
+	record.channels = meta_.channels();
+	record.bits_per_sample = meta_.bits_per_sample();
+	record.sample_rate = meta_.sample_rate();
+	record.duration = meta_.duration();
+	record.bitrate = meta_.bitrate();
+	record.codec = u8(meta_.audio_codec());
+	record.device_id = u64(file_id_.device_id);
+	record.inode_number = u64(file_id_.inode_number);
+	
+	const QVector<audio::Genre> &vec = meta_.genres();
+	record.genre_count = vec.size();
+	record.genres_offset = heap.size();
+	
+	for (u8 i = 0; i < record.genre_count; i++) {
+		const i16 n = i16(vec[i]);
+		heap.add(reinterpret_cast<const char*>(&n), sizeof n);
+	}
+}
+
+QString
+Song::uri() const
+{
+	QString uri_path = QLatin1String("file://") + full_path();
 	
-	for (u8 i = 0; i < count; i++)
-		ba.add_i16(i16(vec[i]));
+	return QUrl(uri_path).toEncoded();
 }
 
 }
@@ -5,6 +5,7 @@
 #include "audio/decl.hxx"
 #include "audio/Meta.hpp"
 #include "decl.hxx"
+#include "dirs.hh"
 #include "types.hxx"
 
 #include <gst/gst.h>
@@ -27,11 +28,21 @@ public:
 	u8&
 	bits() { return bits_; }
 	
-	const QString& dir_path() const { return dir_path_; }
-	void dir_path(const QString  &s) { dir_path_ = s; }
+	u32 dir_id() const { return dir_id_; }
+	void dir_id(const u32 id) { dir_id_ = id; }
 	
-	const QString& display_name() const { return display_name_; }
-	void display_name(const QString &s) { display_name_ = s; }
+	QString
+	dir_path() const { return dirs::Get(dir_id_); }
+	
+	const QString& filename() const;
+	void filename(const QString &s) {
+		filename_ = s;
+		filename_decoded_ = true;
+	}
+	
+	// Not initialized if the file was gone by the time it got stored
+	const io::FileID& file_id() const { return file_id_; }
+	void file_id(const io::FileID &id) { file_id_ = id; }
 	
 	audio::Meta&
 	meta() { return meta_; }
@@ -40,11 +51,21 @@ public:
 	FillIn(audio::TempSongInfo &info);
 	
 	static Song*
-	From(quince::ByteArray &ba, const i64 playlist_id);
+	From(quince::ByteArray &ba, const i64 playlist_id, const bool with_file_id);
+	
+	static Song*
+	From(const SongRecord *record, const i64 playlist_id, const u32 dir_id,
+		const bool with_file_id);
 	
 	static Song*
 	FromFile(const io::File &file, const i64 playlist_id);
 	
+	static Song*
+	FromLegacy(quince::ByteArray &ba, const i64 playlist_id);
+	
+	QString
+	full_path() const;
+	
 	bool
 	is_paused() const { return state_ == GST_STATE_PAUSED; }
 	
@@ -72,23 +93,30 @@ public:
 	void position(const i64 t) { position_ = t; }
 	
 	void
-	SaveTo(quince::ByteArray &ba);
+	SaveTo(quince::ByteArray &ba) const;
+	
+	void
+	SaveTo(SongRecord &record, quince::ByteArray &heap, const u32 dir_index) const;
 	
 	GstState state() const { return state_; }
 	void state(GstState s) { state_ = s; }
 	
-	const QString& uri() const { return uri_; }
-	void uri(const QString &s) { uri_ = s; }
+	QString
+	uri() const; // built from the path each time
 	
 private:
 	GstState state_ = GST_STATE_NULL;
 	i64 position_ = -1;
 	i64 playlist_id_ = -1;
-	QString display_name_;
-	QString uri_;
-	QString dir_path_;
+	// Points into the mmap()ed playlist file (owned by the TableModel),
+	// the file name is decoded from it on first use.
+	const SongRecord *record_ = nullptr;
+	mutable QString filename_;
+	u32 dir_id_ = 0;
+	io::FileID file_id_ = {};
 	audio::Meta meta_ = {};
 	u8 bits_ = 0;
+	mutable bool filename_decoded_ = true;
 };
 
 }
@@ -0,0 +1,113 @@
+#include "WarmPool.hpp"
+
+#include "GstPlayer.hpp"
+
+#include <algorithm>
+
+namespace quince {
+
+WarmPool::WarmPool(GstPlayer *player, const int max_pipelines)
+: player_(player), max_pipelines_(std::max(0, max_pipelines))
+{}
+
+WarmPool::~WarmPool()
+{
+	for (Warm &warm: warm_)
+		player_->DeletePlaybin(warm.elem);
+	
+	for (GstElement *elem: idle_)
+		player_->DeletePlaybin(elem);
+}
+
+void
+WarmPool::Give(GstElement *elem)
+{
+	if (int(warm_.size() + idle_.size()) < max_pipelines_)
+		idle_.push_back(elem);
+	else
+		player_->DeletePlaybin(elem);
+}
+
+void
+WarmPool::Keep(const std::vector<QByteArray> &uris)
+{
+	const usize count = std::min(uris.size(), usize(max_pipelines_));
+	auto wanted_end = uris.begin() + count;
+	
+	for (auto it = warm_.begin(); it != warm_.end();)
+	{
+		if (std::find(uris.begin(), wanted_end, it->uri) != wanted_end) {
+			it++;
+			continue;
+		}
+		
+		GstElement *elem = it->elem;
+		it = warm_.erase(it);
+		Park(elem);
+	}
+	
+	for (auto it = uris.begin(); it != wanted_end; it++)
+	{
+		const QByteArray &uri = *it;
+		auto found = std::find_if(warm_.begin(), warm_.end(),
+			[&uri] (const Warm &warm) { return warm.uri == uri; });
+		
+		if (found != warm_.end())
+			continue;
+		
+		GstElement *elem;
+		
+		if (idle_.empty()) {
+			elem = player_->NewPlaybin();
+		} else {
+			elem = idle_.back();
+			idle_.pop_back();
+		}
+		
+		g_object_set(G_OBJECT(elem), "uri", uri.constData(), NULL);
+		
+		if (gst_element_set_state(elem, GST_STATE_PAUSED) == GST_STATE_CHANGE_FAILURE) {
+			mtl_warn("Can't preroll %s", uri.constData());
+			Park(elem);
+			continue;
+		}
+		
+		warm_.push_back(Warm {elem, uri});
+	}
+	
+	while (!idle_.empty() && int(warm_.size() + idle_.size()) > max_pipelines_)
+	{
+		player_->DeletePlaybin(idle_.back());
+		idle_.pop_back();
+	}
+}
+
+void
+WarmPool::Park(GstElement *elem)
+{
+	gst_element_set_state(elem, GST_STATE_NULL);
+	idle_.push_back(elem);
+}
+
+GstElement*
+WarmPool::Take(const QByteArray &uri)
+{
+	auto it = std::find_if(warm_.begin(), warm_.end(),
+		[&uri] (const Warm &warm) { return warm.uri == uri; });
+	
+	if (it == warm_.end())
+		return nullptr;
+	
+	GstElement *elem = it->elem;
+	warm_.erase(it);
+	
+	// Still prerolling is fine, but not a file that failed to open
+	if (gst_element_get_state(elem, nullptr, nullptr, 0) == GST_STATE_CHANGE_FAILURE) {
+		Park(elem);
+		return nullptr;
+	}
+	
+	return elem;
+}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "decl.hxx"
+#include "err.hpp"
+#include "types.hxx"
+
+#include <gst/gst.h>
+
+#include <QByteArray>
+
+#include <vector>
+
+namespace quince {
+
+/* Playbins already prerolled (paused at the start) for the songs the
+ user is likely to play next, so that skipping to one of them costs a
+ state change instead of opening, typefinding and decoding the file.
+ Each pipeline holds a decoder, its buffers and a (corked) audio sink
+ stream, so there are at most max_pipelines of them, idle ones
+ included. GUI thread only. */
+class WarmPool {
+public:
+	WarmPool(GstPlayer *player, const int max_pipelines);
+	virtual ~WarmPool();
+	
+	// Takes back a pipeline that's done playing, already in NULL state
+	void
+	Give(GstElement *elem);
+	
+	// Prerolls the given uris, most wanted first, and drops the others
+	void
+	Keep(const std::vector<QByteArray> &uris);
+	
+	// The pipeline prerolled for uri or nullptr, the caller owns it
+	GstElement*
+	Take(const QByteArray &uri);
+
+private:
+	NO_ASSIGN_COPY_MOVE(WarmPool);
+	
+	struct Warm {
+		GstElement *elem = nullptr;
+		QByteArray uri;
+	};
+	
+	void Park(GstElement *elem);
+	
+	GstPlayer *player_ = nullptr;
+	const int max_pipelines_;
+	std::vector<Warm> warm_;
+	std::vector<GstElement*> idle_; // in NULL state
+};
+
+}
@@ -12,6 +12,8 @@ const auto PlaylistNew = QLatin1String("PlaylistNew");
 const auto PlaylistDelete = QLatin1String("PlaylistDelete");
 const auto PlaylistRemoveAllEntries = QLatin1String("PlaylistRemoveAllEntries");
 const auto PlaylistRename = QLatin1String("PlaylistRename");
+const auto PlaylistStopWatching = QLatin1String("PlaylistStopWatching");
+const auto PlaylistWatchFolder = QLatin1String("PlaylistWatchFolder");
 const auto QuitApp = QLatin1String("QuitApp");
 const auto RemoveSongsFromPlaylist = QLatin1String("RemoveSongsFromPlaylist");
 const auto RemoveSongsAndDeleteFiles = QLatin1String("Remove songs & delete files");
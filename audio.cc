@@ -1,7 +1,9 @@
 #include "audio.hh"
 
 #include "audio/Meta.hpp"
+#include "audio/mp3.hh"
 #include "err.hpp"
+#include "io/MappedFile.hpp"
 
 #include <cstdlib>
 #include <opusfile.h>
@@ -261,19 +263,117 @@ ReadID3V2Size(std::ifstream& infile, Meta *meta, const char *full_path)
 	return size + 10;
 }
 
+// Extensions are matched as up to 4 lower case ASCII chars packed in a u32
+static constexpr u32
+PackExtension(const char *ext)
+{
+	u32 key = 0;
+	
+	for (int i = 0; ext[i] != '\0'; i++)
+		key = (key << 8) | u8(ext[i]);
+	
+	return key;
+}
+
+struct ExtensionCodec {
+	u32 key;
+	Codec codec;
+};
+
+static constexpr ExtensionCodec ExtensionCodecs[] = {
+	{ PackExtension("mp3"), Codec::Mp3 },
+	{ PackExtension("flac"), Codec::Flac },
+	{ PackExtension("opus"), Codec::OggOpus },
+	{ PackExtension("mka"), Codec::Mka },
+	{ PackExtension("m4a"), Codec::M4a },
+	{ PackExtension("webm"), Codec::Webm },
+};
+
+static inline u32 CharCode(const char c) { return u8(c); }
+static inline u32 CharCode(const QChar c) { return c.unicode(); }
+
+template <typename C> static Codec
+ClassifyName(const C *name, const i64 len)
+{
+	i64 dot = len - 1;
+	
+	// No extension is longer than 4 chars, don't look further back
+	while (dot >= 0 && dot >= len - 5 && CharCode(name[dot]) != '.')
+		dot--;
+	
+	const i64 ext_len = len - dot - 1;
+	
+	if (dot < 0 || CharCode(name[dot]) != '.' || ext_len < 1 || ext_len > 4)
+		return Codec::Unknown;
+	
+	u32 key = 0;
+	
+	for (i64 i = dot + 1; i < len; i++)
+	{
+		u32 c = CharCode(name[i]);
+		
+		if (c >= 'A' && c <= 'Z')
+			c |= 0x20;
+		else if (c > 0x7F)
+			return Codec::Unknown;
+		
+		key = (key << 8) | c;
+	}
+	
+	for (const ExtensionCodec &item: ExtensionCodecs)
+	{
+		if (item.key == key)
+			return item.codec;
+	}
+	
+	return Codec::Unknown;
+}
+
+Codec
+CodecFromFileName(const char *name, const usize len)
+{
+	return ClassifyName(name, i64(len));
+}
+
+Codec
+CodecFromFileName(const QString &name)
+{
+	return ClassifyName(name.constData(), name.size());
+}
+
+// Codecs that are read natively, without a GStreamer pipeline.
+// "complete" means the reader fills in everything the discoverer would.
+static const Probe Probes[] = {
+	{ Codec::Mp3, ReadMp3FileMeta, true },
+	{ Codec::Flac, ReadFlacFileMeta, true },
+	{ Codec::OggOpus, ReadOggOpusFileMeta, true },
+};
+
+const Probe*
+FindProbe(const Codec codec)
+{
+	for (const Probe &probe: Probes)
+	{
+		if (probe.codec == codec)
+			return &probe;
+	}
+	
+	return nullptr;
+}
+
 bool
-ReadFileMeta(const char *full_path, Meta &meta)
+ReadFileMeta(const char *full_path, Meta &meta, bool &complete)
 {
-	if (meta.is_codec_mp3()) {
-		ReadMp3FileMeta(full_path, meta);
-	} else if (meta.is_codec_flac())
-		ReadFlacFileMeta(full_path, meta);
-	else if (meta.is_codec_ogg_opus())
-		ReadOggOpusFileMeta(full_path, meta);
-	else {
-		mtl_trace();
+	complete = false;
+	const Probe *probe = FindProbe(meta.audio_codec());
+	
+	if (probe == nullptr)
+		return false; // left to the discoverer
+	
+	if (!probe->read(full_path, meta))
 		return false;
-	}
+	
+	complete = probe->complete;
 	
 	return true;
 }
@@ -290,53 +390,35 @@ ReadMp3FileMeta(const char *full_path, Meta &meta)
 	}
 	
 	// Get start & end of primary frame data (don't confuse with ID3 tags)
-	infile.seekg(0, std::ios::end);
-	std::streampos data_end = infile.tellg();
-	infile.seekg(0, std::ios::beg);
-	
 	const i32 v1_size = ReadID3V1Size(infile, &meta);
 	const i32 v2_size = ReadID3V2Size(infile, &meta, full_path);
+	infile.close();
 	
-	if (v2_size == -1) {
-		mtl_warn("ID3v 2 not present");
-		infile.close();
-		return false;
-	}
+	io::MappedFile file;
 	
-	data_end -= v1_size;
-	std::streampos data_begin = v2_size;
-	infile.seekg(data_begin, std::ios::beg);
+	if (file.Open(QString::fromLocal8Bit(full_path)) != io::Err::Ok)
+		return false;
 	
-	i32 header = 0;
-	infile.read(reinterpret_cast<char*>(&header), sizeof header);
-	infile.close();
-	header = reverse(header);
-	const MpegVersion mpeg_version = GetMpegVersion(header);
+	const i64 data_begin = (v2_size == -1) ? 0 : v2_size;
+	const i64 data_end = file.size() - v1_size;
 	
-	if (mpeg_version != MpegVersion::_1 ||
-		GetMpegLayer(header) != MpegLayer::_3)
-	{
-		mtl_trace("Not MPEG_1_3: \"%s\"", full_path);
+	if (data_begin >= data_end)
 		return false;
-	}
 	
-	i32 sample_rate = GetMpegSampleRate(header, mpeg_version);
-	meta.sample_rate(sample_rate);
-	meta.channels(GetMpegChannels(header));
+	mp3::Stream stream;
+	const u8 *data = reinterpret_cast<const u8*>(file.data());
 	
-	// determine bitrate based on header for first frame of audio data
-	const i32 index = i32((header >> 12) & 0xF);
-	
-	if (index < 0 | index > Mp3BitrateArrayLen)
+	if (!mp3::Probe(data, data_begin, data_end, stream)) {
+		mtl_trace("No MPEG audio frames: \"%s\"", full_path);
 		return false;
+	}
 	
-	i32 bitrate = Mp3Bitrates[index];
-	meta.bitrate(bitrate);
+	meta.sample_rate(stream.sample_rate);
+	meta.channels(stream.channels);
+	meta.bitrate(stream.bitrate);
 	
 	const i64 to_ns = 1000000000L;
-	i64 bitrate_in_bytes = bitrate / 8;
-	i64 n = i64(data_end - data_begin) * to_ns / bitrate_in_bytes;
-	meta.duration(n);
+	meta.duration(stream.sample_count * to_ns / stream.sample_rate);
 	
 	return true;
 }
@@ -369,6 +451,8 @@ ReadFlacFileMeta(const char *full_path, Meta &meta)
 	
 	uchar meta_block[meta_block_size]; // 272 bits (34 bytes)
 	infile.read(reinterpret_cast<char*>(meta_block), meta_block_size);
+	infile.seekg(0, std::ios::end);
+	const i64 file_size = infile.tellg();
 	infile.close();
 	
 	const i32 off_bits = 16 + 16 + 24 + 24;
@@ -415,11 +499,13 @@ ReadFlacFileMeta(const char *full_path, Meta &meta)
 	total_samples >>= shift;
 	total_samples &= 0x0000000FFFFFFFFF;
 	
-	// Compute bitrate:
-	// 44,100 samples per second × 16 bits per sample × 2 channels
-	// = 1,411,200 bits per second (or 1,411.2 kbps)
-	const i32 bitrate = sample_rate * bits_per_sample * num_channels;
-	meta.bitrate(bitrate);
+	if (sample_rate == 0 || total_samples == 0)
+		return false; // unknown length, leave it to the discoverer
+	
+	// The encoded bitrate like the discoverer reports it, from the file
+	// size over the duration, not the PCM one (rate × bits × channels).
+	if (file_size > 0)
+		meta.bitrate(i32(file_size * 8 * i64(sample_rate) / total_samples));
 	
 	const i64 to_ns = 1000000000L;
 	i64 n = total_samples * to_ns / i64(sample_rate);
@@ -467,7 +553,7 @@ ReadOggOpusFileMeta(const char *full_path, Meta &meta)
 	const i64 pcm = op_pcm_total(opus_file, -1);
 	op_free(opus_file);
 	
-	i64 n = (pcm / 48000L) * 1000'000'000L;
+	i64 n = pcm * 1000'000'000L / 48000L;
 	meta.duration(n);
 	
 	
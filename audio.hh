@@ -12,6 +12,25 @@
 
 namespace quince::audio {
 
+typedef bool (*MetaReader)(const char *full_path, Meta &meta);
+
+struct Probe {
+	Codec codec;
+	MetaReader read;
+	bool complete;
+};
+
+// The codec a song file is assumed to have judging by its extension,
+// Codec::Unknown for files that aren't songs.
+Codec
+CodecFromFileName(const char *name, const usize len);
+
+Codec
+CodecFromFileName(const QString &name);
+
+const Probe*
+FindProbe(const Codec codec);
+
 bool
 GenresFromString(const QStringRef &s, QVector<Genre> &vec);
 
@@ -37,7 +56,7 @@ bool
 ReadOggOpusFileMeta(const char *full_path, Meta &meta);
 
 bool
-ReadFileMeta(const char *full_path, Meta &meta);
+ReadFileMeta(const char *full_path, Meta &meta, bool &complete);
 
 //How much room does ID3 version 1 tag info
 //take up at the end of this file (if any)?
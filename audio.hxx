@@ -73,12 +73,14 @@ enum class Mp3ChannelMode {
 	SingleChannel = 3, // Mono
 };
 
-enum class Codec : u8 {
+enum class Codec : u8 { // stored in playlist files, only append
 	Unknown,
 	Mp3,
 	OggOpus,
 	Flac,
-	Mka
+	Mka,
+	M4a,
+	Webm
 };
 
 enum class Genre : i16 {
@@ -1,6 +1,7 @@
 #include "Meta.hpp"
 
 #include "../audio.hh"
+#include "../ByteArray.hpp"
 
 #include <QDate>
 #include <QDir>
@@ -162,4 +163,53 @@ Meta::InterpretOpusInfo(OggOpusFile *opus_file)
 	
 }
 
+void
+Meta::Read(quince::ByteArray &ba, const bool with_tags)
+{
+	channels_ = ba.next_i8();
+	bits_per_sample_ = ba.next_i8();
+	sample_rate_ = ba.next_i32();
+	duration_ = ba.next_i64();
+	bitrate_ = ba.next_i32();
+	audio_codec_ = Codec(ba.next_u8());
+	
+	const u8 count = ba.next_u8();
+	genres_.clear();
+	
+	for (u8 i = 0; i < count; i++) {
+		genres_.append(Genre(ba.next_i16()));
+	}
+	
+	if (with_tags) {
+		song_name_ = ba.next_string();
+		artist_ = ba.next_string();
+		album_ = ba.next_string();
+		year_ = ba.next_i32();
+	}
+}
+
+void
+Meta::SaveTo(quince::ByteArray &ba, const bool with_tags) const
+{
+	ba.add_i8(channels_);
+	ba.add_i8(bits_per_sample_);
+	ba.add_i32(sample_rate_);
+	ba.add_i64(duration_);
+	ba.add_i32(bitrate_);
+	ba.add_u8(u8(audio_codec_));
+	
+	const u8 count = genres_.size();
+	ba.add_u8(count);
+	
+	for (u8 i = 0; i < count; i++)
+		ba.add_i16(i16(genres_[i]));
+	
+	if (with_tags) {
+		ba.add_string(song_name_);
+		ba.add_string(artist_);
+		ba.add_string(album_);
+		ba.add_i32(year_);
+	}
+}
+
 }
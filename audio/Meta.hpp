@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../audio.hxx"
+#include "../decl.hxx"
 #include "../err.hpp"
 
 #include <opusfile.h>
@@ -53,6 +54,7 @@ public:
 	void channels(i8 n) { channels_ = n; }
 	
 	QVector<Genre>& genres() { return genres_; }
+	const QVector<Genre>& genres() const { return genres_; }
 	
 	i32 sample_rate() const { return sample_rate_; }
 	void sample_rate(i32 n) { sample_rate_ = n; }
@@ -63,6 +65,12 @@ public:
 	i32
 	InterpretTagV2Frame(const char *buf, const char *full_path, const i64 max);
 	
+	void
+	Read(quince::ByteArray &ba, const bool with_tags);
+	
+	void
+	SaveTo(quince::ByteArray &ba, const bool with_tags) const;
+	
 private:
 	
 	i8 channels_ = -1;
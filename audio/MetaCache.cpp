@@ -0,0 +1,238 @@
+#include "MetaCache.hpp"
+
+#include "../App.hpp"
+#include "../ByteArray.hpp"
+#include "../io/io.hh"
+
+#include <algorithm>
+#include <sys/stat.h>
+#include <time.h>
+
+namespace quince::audio {
+
+// Bytes before the genre count: the key and the fixed part of a Meta
+static const usize EntryHeadSize = 8 * 4 + 1 + 1 + 4 + 8 + 4 + 1;
+
+static i32
+Today() { return i32(time(nullptr) / (60 * 60 * 24)); }
+
+// Moves past one entry if all of it is within end, see Meta::SaveTo()
+static bool
+SkipEntry(ByteArray &ba, const usize end, const bool with_day)
+{
+	if (ba.at() + EntryHeadSize + 1 > end)
+		return false;
+	
+	ba.to(ba.at() + EntryHeadSize);
+	const usize genres_size = ba.next_u8() * sizeof(i16);
+	
+	if (ba.at() + genres_size > end)
+		return false;
+	
+	ba.to(ba.at() + genres_size);
+	
+	for (int i = 0; i < 3; i++) // name, artist, album
+	{
+		if (ba.at() + sizeof(i32) > end)
+			return false;
+		
+		const i32 len = ba.next_i32();
+		
+		if (len < 0 || ba.at() + len > end)
+			return false;
+		
+		ba.to(ba.at() + len);
+	}
+	
+	const usize tail = sizeof(i32) + (with_day ? sizeof(i32) : 0); // year, day
+	
+	if (ba.at() + tail > end)
+		return false;
+	
+	ba.to(ba.at() + tail);
+	
+	return true;
+}
+
+usize
+MetaCacheKeyHash::operator()(const MetaCacheKey &key) const
+{
+	u64 h = u64(key.id.inode_number);
+	h = h * 0x9E3779B97F4A7C15ull ^ u64(key.id.device_id);
+	h = h * 0x9E3779B97F4A7C15ull ^ u64(key.size);
+	h = h * 0x9E3779B97F4A7C15ull ^ u64(key.mtime);
+	return usize(h ^ (h >> 29));
+}
+
+MetaCache::MetaCache() {}
+MetaCache::~MetaCache() {}
+
+bool
+MetaCache::KeyFromPath(const char *full_path, MetaCacheKey &key)
+{
+	struct stat st;
+	
+	if (stat(full_path, &st) != 0)
+		return false;
+	
+	key.id = io::FileID {
+		.device_id = st.st_dev,
+		.inode_number = st.st_ino
+	};
+	key.size = st.st_size;
+	key.mtime = i64(st.st_mtim.tv_sec) * 1000000000L + st.st_mtim.tv_nsec;
+	
+	return true;
+}
+
+bool
+MetaCache::Load()
+{
+	QString full_path;
+	CHECK_TRUE(QueryFilePath(full_path));
+	auto path_ba = full_path.toLocal8Bit();
+	
+	if (!io::FileExists(path_ba.data()))
+		return true; // nothing cached yet
+	
+	ByteArray ba;
+	
+	if (io::ReadFile(full_path, ba) != io::Err::Ok) {
+		mtl_trace("Couldn't read file: %s", path_ba.data());
+		return false;
+	}
+	
+	const usize file_size = ba.size();
+	
+	if (file_size < sizeof(i32) * 2)
+		return false;
+	
+	const i32 version = ba.next_i32();
+	
+	if (version != MetaCacheVersion && version != MetaCacheVersionNoDays)
+		return false;
+	
+	const bool with_day = version == MetaCacheVersion;
+	const i32 count = ba.next_i32();
+	const i32 today = Today();
+	std::lock_guard<std::mutex> guard(mutex_);
+	
+	if (count > 0)
+		map_.reserve(map_.size() + std::min(count, i32(file_size / EntryHeadSize)));
+	
+	for (i32 i = 0; i < count; i++)
+	{
+		const usize at = ba.at();
+		
+		if (!SkipEntry(ba, file_size, with_day)) {
+			mtl_warn("Metadata cache is cut short, dropped the rest");
+			modified_ = true;
+			break;
+		}
+		
+		ba.to(at);
+		MetaCacheKey key;
+		key.id.device_id = dev_t(ba.next_u64());
+		key.id.inode_number = ino_t(ba.next_u64());
+		key.size = ba.next_i64();
+		key.mtime = ba.next_i64();
+		MetaCacheEntry entry;
+		entry.meta.Read(ba, true);
+		entry.day = with_day ? ba.next_i32() : today;
+		
+		if (today - entry.day > MetaCacheMaxUnusedDays) {
+			modified_ = true; // gets dropped from the file
+			continue;
+		}
+		
+		// Entries stored during this session are newer, don't overwrite.
+		map_.emplace(key, entry);
+	}
+	
+	if (!with_day)
+		modified_ = true;
+	
+	return true;
+}
+
+bool
+MetaCache::Lookup(const MetaCacheKey &key, Meta &meta)
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+	auto it = map_.find(key);
+	
+	if (it == map_.end())
+		return false;
+	
+	MetaCacheEntry &entry = it->second;
+	meta = entry.meta;
+	const i32 today = Today();
+	
+	if (entry.day != today) { // keeps it from being dropped
+		entry.day = today;
+		modified_ = true;
+	}
+	
+	return true;
+}
+
+bool
+MetaCache::QueryFilePath(QString &full_path)
+{
+	QString dir_path;
+	CHECK_TRUE(App::QueryAppConfigPath(dir_path));
+	full_path = dir_path + QLatin1String("/MetaCache");
+	
+	return true;
+}
+
+bool
+MetaCache::Save()
+{
+	ByteArray ba;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		
+		if (!modified_)
+			return true;
+		
+		ba.add_i32(MetaCacheVersion);
+		ba.add_i32(i32(map_.size()));
+		
+		for (const auto &item: map_)
+		{
+			const MetaCacheKey &key = item.first;
+			ba.add_u64(u64(key.id.device_id));
+			ba.add_u64(u64(key.id.inode_number));
+			ba.add_i64(key.size);
+			ba.add_i64(key.mtime);
+			item.second.meta.SaveTo(ba, true);
+			ba.add_i32(item.second.day);
+		}
+		
+		modified_ = false;
+	}
+	
+	QString full_path;
+	CHECK_TRUE(QueryFilePath(full_path));
+	
+	if (io::ReplaceFile(full_path, ba.data(), ba.size()) != io::Err::Ok) {
+		mtl_warn("Error occured writing to file");
+		return false;
+	}
+	
+	return true;
+}
+
+void
+MetaCache::Store(const MetaCacheKey &key, const Meta &meta)
+{
+	if (!key.Initialized())
+		return;
+	
+	std::lock_guard<std::mutex> guard(mutex_);
+	map_[key] = MetaCacheEntry {meta, Today()};
+	modified_ = true;
+}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Meta.hpp"
+#include "../decl.hxx"
+#include "../err.hpp"
+#include "../io/io.hxx"
+#include "../types.hxx"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace quince::audio {
+
+static const i32 MetaCacheVersion = 2;
+static const i32 MetaCacheVersionNoDays = 1; // still read
+
+// Entries not used for this long are dropped, their files are
+// most likely gone or changed (which makes for a new key).
+static const i32 MetaCacheMaxUnusedDays = 90;
+
+// A file is considered unchanged as long as it's the same inode with
+// the same size and modification time.
+struct MetaCacheKey {
+	io::FileID id = {};
+	i64 size = -1;
+	i64 mtime = -1;
+	
+	bool
+	operator == (const MetaCacheKey &rhs) const {
+		return id == rhs.id && size == rhs.size && mtime == rhs.mtime;
+	}
+	
+	bool
+	Initialized() const { return id.Initialized() && size != -1; }
+};
+
+struct MetaCacheKeyHash {
+	usize operator()(const MetaCacheKey &key) const;
+};
+
+struct MetaCacheEntry {
+	Meta meta;
+	i32 day = 0; // when it was last looked up or stored, days since 1970
+};
+
+// Song metadata from previous imports, stored in the app config folder.
+// Lookup() and Store() can be called from any thread.
+class MetaCache {
+public:
+	MetaCache();
+	virtual ~MetaCache();
+	
+	static bool
+	KeyFromPath(const char *full_path, MetaCacheKey &key);
+	
+	bool
+	Load();
+	
+	bool
+	Lookup(const MetaCacheKey &key, Meta &meta);
+	
+	bool
+	Save();
+	
+	void
+	Store(const MetaCacheKey &key, const Meta &meta);
+
+private:
+	NO_ASSIGN_COPY_MOVE(MetaCache);
+	
+	static bool
+	QueryFilePath(QString &full_path);
+	
+	std::mutex mutex_;
+	std::unordered_map<MetaCacheKey, MetaCacheEntry, MetaCacheKeyHash> map_;
+	bool modified_ = false;
+};
+
+}
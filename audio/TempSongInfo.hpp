@@ -22,7 +22,6 @@ public:
 	bool
 	is_playing_or_paused() const { return is_playing() || is_paused(); }
 	
-	QString uri;
 	quince::Song *song = nullptr; // might be null at any time
 	i64 duration = -1;
 	i64 position = -1;
@@ -0,0 +1,294 @@
+#include "mp3.hh"
+
+#include "../err.hpp"
+
+#include <cstring>
+
+namespace quince::audio::mp3 {
+
+// kbps, indexed by the header's bitrate bits, 0 is "free format"
+static const i16 BitratesV1L1[16] = { 0, 32, 64, 96, 128, 160, 192, 224,
+	256, 288, 320, 352, 384, 416, 448, -1 };
+static const i16 BitratesV1L2[16] = { 0, 32, 48, 56, 64, 80, 96, 112,
+	128, 160, 192, 224, 256, 320, 384, -1 };
+static const i16 BitratesV1L3[16] = { 0, 32, 40, 48, 56, 64, 80, 96,
+	112, 128, 160, 192, 224, 256, 320, -1 };
+static const i16 BitratesV2L1[16] = { 0, 32, 48, 56, 64, 80, 96, 112,
+	128, 144, 160, 176, 192, 224, 256, -1 };
+static const i16 BitratesV2L23[16] = { 0, 8, 16, 24, 32, 40, 48, 56,
+	64, 80, 96, 112, 128, 144, 160, -1 };
+
+static const i32 XingFlagFrames = 0x1;
+static const i32 XingFlagBytes = 0x2;
+static const i32 XingFlagToc = 0x4;
+static const i32 XingFlagQuality = 0x8;
+static const i32 XingTocSize = 100;
+static const i32 VbriOffset = 4 + 32;
+static const i32 LameTagSize = 24;
+
+static u32
+ReadBE32(const u8 *p)
+{
+	return (u32(p[0]) << 24) | (u32(p[1]) << 16) | (u32(p[2]) << 8) | u32(p[3]);
+}
+
+static bool
+SameStream(const FrameHeader &a, const FrameHeader &b)
+{
+	return a.version == b.version && a.layer == b.layer &&
+		a.sample_rate == b.sample_rate;
+}
+
+static bool
+Finish(Stream &s, const i32 samples_per_frame)
+{
+	const i64 total = s.frame_count * samples_per_frame;
+	
+	if (total <= 0 || s.sample_rate <= 0)
+		return false;
+	
+	s.sample_count = total - s.encoder_delay - s.encoder_padding;
+	
+	if (s.sample_count <= 0)
+		s.sample_count = total;
+	
+	s.bitrate = i32(s.byte_count * 8 * s.sample_rate / total);
+	
+	return true;
+}
+
+i64
+FindFrame(const u8 *data, const i64 from, const i64 end, FrameHeader &h)
+{
+	i64 pos = from;
+	
+	while (pos + 4 <= end)
+	{ // memchr() skips ahead many bytes at a time looking for the sync byte
+		const void *hit = memchr(data + pos, 0xFF, end - pos - 3);
+		
+		if (hit == nullptr)
+			return -1;
+		
+		pos = static_cast<const u8*>(hit) - data;
+		
+		if ((data[pos + 1] & 0xE0) == 0xE0 && ParseFrameHeader(data + pos, h))
+		{ // a lone valid looking header is too easy to come across by chance
+			const i64 next = pos + h.frame_size;
+			FrameHeader next_h;
+			
+			if (next + 4 > end) {
+				if (next <= end)
+					return pos;
+			} else if (ParseFrameHeader(data + next, next_h) && SameStream(h, next_h)) {
+				return pos;
+			}
+		}
+		
+		pos++;
+	}
+	
+	return -1;
+}
+
+bool
+ParseFrameHeader(const u8 *p, FrameHeader &h)
+{
+	const u32 n = ReadBE32(p);
+	
+	if ((n & 0xFFE00000) != 0xFFE00000)
+		return false;
+	
+	switch ((n >> 19) & 0x3)
+	{
+	case 0: { h.version = MpegVersion::_2_5; break; }
+	case 2: { h.version = MpegVersion::_2; break; }
+	case 3: { h.version = MpegVersion::_1; break; }
+	default: return false;
+	}
+	
+	switch ((n >> 17) & 0x3)
+	{
+	case 1: { h.layer = MpegLayer::_3; break; }
+	case 2: { h.layer = MpegLayer::_2; break; }
+	case 3: { h.layer = MpegLayer::_1; break; }
+	default: return false;
+	}
+	
+	const i32 bitrate_index = (n >> 12) & 0xF;
+	const i32 sample_rate_index = (n >> 10) & 0x3;
+	
+	// Free format streams can't be walked frame by frame
+	if (bitrate_index == 0 || bitrate_index == 15 ||
+		sample_rate_index == 3 || (n & 0x3) == 2)
+		return false;
+	
+	const bool v1 = h.version == MpegVersion::_1;
+	const i16 *bitrates;
+	
+	if (h.layer == MpegLayer::_1)
+		bitrates = v1 ? BitratesV1L1 : BitratesV2L1;
+	else if (h.layer == MpegLayer::_2)
+		bitrates = v1 ? BitratesV1L2 : BitratesV2L23;
+	else
+		bitrates = v1 ? BitratesV1L3 : BitratesV2L23;
+	
+	h.bitrate = i32(bitrates[bitrate_index]) * 1000;
+	h.sample_rate = Mp3SampleRates[sample_rate_index];
+	
+	if (h.version == MpegVersion::_2)
+		h.sample_rate /= 2;
+	else if (h.version == MpegVersion::_2_5)
+		h.sample_rate /= 4;
+	
+	const i32 padding = (n >> 9) & 0x1;
+	const bool mono = ((n >> 6) & 0x3) == i32(Mp3ChannelMode::SingleChannel);
+	h.channels = mono ? 1 : 2;
+	
+	if (h.layer == MpegLayer::_1) {
+		h.samples_per_frame = 384;
+		h.frame_size = (12 * h.bitrate / h.sample_rate + padding) * 4;
+	} else if (h.layer == MpegLayer::_2 || v1) {
+		h.samples_per_frame = 1152;
+		h.frame_size = 144 * h.bitrate / h.sample_rate + padding;
+	} else {
+		h.samples_per_frame = 576;
+		h.frame_size = 72 * h.bitrate / h.sample_rate + padding;
+	}
+	
+	if (h.layer == MpegLayer::_3)
+		h.side_info_size = v1 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+	else
+		h.side_info_size = 0;
+	
+	return h.frame_size > 4;
+}
+
+bool
+Probe(const u8 *data, const i64 begin, const i64 end, Stream &s)
+{
+	FrameHeader h;
+	const i64 at = FindFrame(data, begin, end, h);
+	
+	if (at == -1)
+		return false;
+	
+	s = Stream();
+	s.sample_rate = h.sample_rate;
+	s.channels = h.channels;
+	
+	if (ReadInfoFrame(data + at, end - at, h, s))
+	{
+		if (s.byte_count <= 0) // the audio frames after the info frame
+			s.byte_count = end - at - h.frame_size;
+		
+		if (Finish(s, h.samples_per_frame))
+			return true;
+	}
+	
+	return ScanFrames(data, at, end, s);
+}
+
+bool
+ReadInfoFrame(const u8 *frame, const i64 avail, const FrameHeader &h,
+	Stream &s)
+{
+	const i64 xing_at = 4 + h.side_info_size;
+	
+	if (h.layer == MpegLayer::_3 && avail >= xing_at + 8 &&
+		(memcmp(frame + xing_at, "Xing", 4) == 0 ||
+		memcmp(frame + xing_at, "Info", 4) == 0))
+	{
+		const u32 flags = ReadBE32(frame + xing_at + 4);
+		i64 at = xing_at + 8;
+		
+		if (!(flags & XingFlagFrames) || avail < at + 4)
+			return false;
+		
+		s.frame_count = ReadBE32(frame + at);
+		at += 4;
+		
+		if (flags & XingFlagBytes) {
+			if (avail >= at + 4)
+				s.byte_count = ReadBE32(frame + at);
+			at += 4;
+		}
+		
+		if (flags & XingFlagToc)
+			at += XingTocSize;
+		
+		if (flags & XingFlagQuality)
+			at += 4;
+		
+		// LAME (and FFmpeg, which writes a compatible tag) store the
+		// encoder delay and padding in 12 bits each.
+		if (avail >= at + LameTagSize && (memcmp(frame + at, "LAME", 4) == 0 ||
+			memcmp(frame + at, "Lavc", 4) == 0))
+		{
+			const u8 *p = frame + at + 21;
+			s.encoder_delay = (i32(p[0]) << 4) | (p[1] >> 4);
+			s.encoder_padding = (i32(p[1] & 0x0F) << 8) | p[2];
+		}
+		
+		s.vbr = memcmp(frame + xing_at, "Xing", 4) == 0;
+		
+		return s.frame_count > 0;
+	}
+	
+	if (avail >= VbriOffset + 18 && memcmp(frame + VbriOffset, "VBRI", 4) == 0)
+	{
+		const u8 *p = frame + VbriOffset;
+		s.encoder_delay = (i32(p[6]) << 8) | p[7];
+		s.byte_count = ReadBE32(p + 10);
+		s.frame_count = ReadBE32(p + 14);
+		s.vbr = true;
+		
+		return s.frame_count > 0;
+	}
+	
+	return false;
+}
+
+bool
+ScanFrames(const u8 *data, const i64 begin, const i64 end, Stream &s)
+{
+	FrameHeader first;
+	i64 pos = FindFrame(data, begin, end, first);
+	
+	if (pos == -1)
+		return false;
+	
+	s = Stream();
+	s.sample_rate = first.sample_rate;
+	s.channels = first.channels;
+	i32 last_bitrate = first.bitrate;
+	
+	while (pos + 4 <= end)
+	{
+		FrameHeader h;
+		
+		if (!ParseFrameHeader(data + pos, h) || !SameStream(first, h))
+		{ // junk between frames or a trailing tag, sync up again
+			pos = FindFrame(data, pos + 1, end, h);
+			
+			if (pos == -1)
+				break;
+			
+			continue;
+		}
+		
+		if (pos + h.frame_size > end)
+			break; // a truncated last frame
+		
+		if (h.bitrate != last_bitrate)
+			s.vbr = true;
+		
+		last_bitrate = h.bitrate;
+		s.frame_count++;
+		s.byte_count += h.frame_size;
+		pos += h.frame_size;
+	}
+	
+	return Finish(s, first.samples_per_frame);
+}
+
+}
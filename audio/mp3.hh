@@ -0,0 +1,57 @@
+#pragma once
+
+#include "../audio.hxx"
+#include "../types.hxx"
+
+/* Reads the exact length of an MP3 stream without decoding it:
+ from the Xing/Info or VBRI header in its first frame (together with
+ the encoder delay and padding from a LAME tag) when there is one,
+ otherwise by walking the frame headers of the whole stream.
+ https://www.mp3-tech.org/programmer/frame_header.html */
+
+namespace quince::audio::mp3 {
+
+struct FrameHeader {
+	MpegVersion version = MpegVersion::None;
+	MpegLayer layer = MpegLayer::None;
+	i32 bitrate = 0; // bits per second
+	i32 sample_rate = 0;
+	i32 samples_per_frame = 0;
+	i32 frame_size = 0; // bytes, the 4 header bytes included
+	i32 side_info_size = 0;
+	i8 channels = 0;
+};
+
+struct Stream {
+	i64 frame_count = 0;
+	i64 sample_count = 0; // without the encoder delay and padding
+	i64 byte_count = 0;
+	i32 encoder_delay = 0;
+	i32 encoder_padding = 0;
+	i32 bitrate = 0; // the average one for VBR streams
+	i32 sample_rate = 0;
+	i8 channels = 0;
+	bool vbr = false;
+};
+
+// Returns the offset of the first frame at or after "from" that is
+// followed by another one (or by the end of the data), -1 if none.
+i64
+FindFrame(const u8 *data, const i64 from, const i64 end, FrameHeader &h);
+
+bool
+ParseFrameHeader(const u8 *p, FrameHeader &h);
+
+// Reads the stream between [begin, end), which must not include
+// the ID3 tags.
+bool
+Probe(const u8 *data, const i64 begin, const i64 end, Stream &s);
+
+bool
+ReadInfoFrame(const u8 *frame, const i64 avail, const FrameHeader &h,
+	Stream &s);
+
+bool
+ScanFrames(const u8 *data, const i64 begin, const i64 end, Stream &s);
+
+}
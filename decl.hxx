@@ -5,9 +5,28 @@
 namespace quince {
 class App;
 class ByteArray;
+class DiscovererPool;
 class Duration;
+class FolderWatcher;
 class GstPlayer;
+class Importer;
+class PlaylistFile;
+class PlaylistJournal;
+class PlaylistLoader;
+class Prefetcher;
+class Resumer;
+class Saver;
 class Song;
+struct SongRecord;
+class WarmPool;
+
+namespace load {
+struct Result;
+}
+
+namespace watch {
+struct Event;
+}
 
 enum class PlaylistActivationOption: u8 {
 	None,
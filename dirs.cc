@@ -0,0 +1,41 @@
+#include "dirs.hh"
+
+#include <QHash>
+#include <QVector>
+
+#include <mutex>
+
+namespace quince::dirs {
+
+static std::mutex table_mutex;
+static QHash<QString, u32> table_ids;
+static QVector<QString> table_paths;
+
+QString
+Get(const u32 id)
+{
+	std::lock_guard<std::mutex> guard(table_mutex);
+	
+	if (id >= u32(table_paths.size()))
+		return QString();
+	
+	return table_paths[id];
+}
+
+u32
+Intern(const QString &dir_path)
+{
+	std::lock_guard<std::mutex> guard(table_mutex);
+	auto it = table_ids.constFind(dir_path);
+	
+	if (it != table_ids.constEnd())
+		return it.value();
+	
+	const u32 id = table_paths.size();
+	table_paths.append(dir_path);
+	table_ids.insert(dir_path, id);
+	
+	return id;
+}
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "types.hxx"
+
+#include <QString>
+
+/* A process wide table of the folders songs live in, so that
+ each song stores just a folder id next to its file name.
+ Ids are never reused, the functions can be called from any thread. */
+
+namespace quince::dirs {
+
+QString
+Get(const u32 id);
+
+u32
+Intern(const QString &dir_path);
+
+}
@@ -1,6 +1,7 @@
 #include "Playlist.hpp"
 
 #include "../App.hpp"
+#include "../FolderWatcher.hpp"
 #include "../io/File.hpp"
 #include "../GstPlayer.hpp"
 #include "../Song.hpp"
@@ -8,6 +9,7 @@
 #include "TableModel.hpp"
 
 #include <QBoxLayout>
+#include <QItemSelectionModel>
 
 namespace quince::gui {
 
@@ -19,6 +21,7 @@ Playlist::Playlist(App *app, const QString &name)
 
 Playlist::~Playlist()
 {
+	delete watcher_;
 	delete table_;
 }
 
@@ -38,6 +41,8 @@ Playlist::CreateGui()
 	table_->setColumnWidth(i8(Column::Genre), 200);
 	
 	connect(table_, &QTableView::doubleClicked, this, &Playlist::MouseDoubleClick);
+	connect(table_->selectionModel(), &QItemSelectionModel::currentRowChanged,
+		[this] { app_->player()->WarmUpSoon(); });
 	
 	QBoxLayout *layout = new QBoxLayout(QBoxLayout::TopToBottom);
 	setLayout(layout);
@@ -79,13 +84,7 @@ Playlist::GetFullPath(QString &full_path) const
 bool
 Playlist::has(Song *song) const
 {
-	for (Song *p: songs())
-	{
-		if (p == song)
-			return true;
-	}
-	
-	return false;
+	return table_model_->has(song);
 }
 
 void
@@ -138,16 +137,14 @@ Playlist::QuerySaveFolder(QString &ret_val)
 i32
 Playlist::RemoveAllSongs()
 {
-	QVector<Song*> &songs = table_model_->songs();
+	const i32 count = table_model_->songs().size();
+	
+	if (count == 0)
+		return 0;
+	
+	table_model_->removeRows(0, count, QModelIndex());
+	journal_.Remove(0, count);
 	
-	i32 count = 0;
-	for (i32 i = songs.size() - 1; i >= 0; i--)
-	{
-		quince::Song *song = songs[i];
-		table_model_->removeRows(i, 1, QModelIndex());
-		count++;
-	}
-
 	return count;
 }
 
@@ -159,34 +156,13 @@ Playlist::RemoveSelectedSongs()
 	if (list.isEmpty())
 		return 0;
 	
-	QVector<Song*> &songs = table_model_->songs();
+	QVector<i32> rows;
+	rows.reserve(list.size());
 	
 	for (auto &next: list)
-	{
-		int row = next.row();
-		
-		if (row < 0 || row >= songs.size()) {
-			mtl_trace("%d", row);
-			continue;
-		}
-		
-		songs[row]->mark_for_deletion();
-	}
+		rows.append(next.row());
 	
-	i32 count = 0;
-	for (i32 i = songs.size() - 1; i >= 0; i--)
-	{
-		quince::Song *song = songs[i];
-		
-		if (song->marked_for_deletion())
-		{
-			//mtl_info("Deleting index %d", i);
-			table_model_->removeRows(i, 1, QModelIndex());
-			count++;
-		}
-	}
-
-	return count;
+	return table_model_->RemoveRows(rows);
 }
 
 QVector<Song*>&
@@ -197,7 +173,18 @@ Playlist::visible(const bool flag)
 {
 	must_be_visible_ = flag;
 	
-	table_model_->StartOrStopTimer();
+	if (flag)
+		table_model_->PositionTicked();
+}
+
+void
+Playlist::watcher(FolderWatcher *p)
+{
+	if (p == watcher_)
+		return;
+	
+	delete watcher_; // saves what it has seen so far
+	watcher_ = p;
 }
 
 }
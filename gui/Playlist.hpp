@@ -3,6 +3,7 @@
 #include "decl.hxx"
 #include "../decl.hxx"
 #include "../err.hpp"
+#include "../PlaylistJournal.hpp"
 #include "../types.hxx"
 
 #include <QWidget>
@@ -30,6 +31,13 @@ public:
 	bool
 	has(Song *song) const;
 	
+	PlaylistJournal&
+	journal() { return journal_; }
+	
+	// False until the songs were read from disk (see PlaylistLoader)
+	bool loaded() const { return loaded_; }
+	void loaded(const bool flag) { loaded_ = flag; }
+	
 	void
 	id(const i64 n) { id_ = n; }
 	
@@ -66,6 +74,10 @@ public:
 	bool visible() const { return must_be_visible_; }
 	void visible(const bool flag);
 	
+	// Takes ownership, nullptr stops watching
+	FolderWatcher* watcher() const { return watcher_; }
+	void watcher(FolderWatcher *p);
+	
 protected:
 	
 private:
@@ -75,8 +87,11 @@ private:
 	QString name_;
 	TableModel *table_model_ = nullptr;
 	Table *table_ = nullptr;
+	PlaylistJournal journal_;
+	FolderWatcher *watcher_ = nullptr; // keeps the songs in sync with folders
 	i64 id_ = -1;
 	PlaylistActivationOption activation_option_ = PlaylistActivationOption::None;
 	bool must_be_visible_ = false;
+	bool loaded_ = true;
 };
 }
@@ -107,6 +107,7 @@ SeekPane::SliderPressed()
 {
 	last_seeked_ = {0, 0};
 	slider_dragged_by_user_ = true;
+	app_->player()->scrubbing(true);
 }
 
 void
@@ -115,6 +116,7 @@ SeekPane::SliderReleased()
 	i64 pos = i64(slider_->value()) * NS_MS_RATIO;
 	app_->player()->SeekTo(pos);
 	slider_dragged_by_user_ = false;
+	app_->player()->scrubbing(false);
 }
 
 void
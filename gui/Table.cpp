@@ -214,7 +214,6 @@ Table::RemoveSongsAndDeleteFiles(const QModelIndexList &indices)
 	const Qt::KeyboardModifiers mods = QGuiApplication::queryKeyboardModifiers();
 	bool confirm_delete = (mods & Qt::ShiftModifier) == 0;
 	
-	const QString url_prefix = QLatin1String("file://");
 	std::map<int, Song*> song_map;
 	QVector<Song*> &songs = table_model_->songs();
 	
@@ -223,14 +222,12 @@ Table::RemoveSongsAndDeleteFiles(const QModelIndexList &indices)
 		song_map[row_index] = songs[row_index];
 	}
 	
+	QVector<i32> rows;
+	
 	for (auto iter = song_map.rbegin(); iter != song_map.rend(); ++iter)
 	{
 		Song *song = iter->second;
 		int row = iter->first;
-		QUrl url(song->uri());
-		
-		if (!url.isLocalFile())
-			continue;
 		
 		if (confirm_delete) {
 			QMessageBox::StandardButton reply = QMessageBox::question(this, "Confirm",
@@ -243,17 +240,19 @@ Table::RemoveSongsAndDeleteFiles(const QModelIndexList &indices)
 			confirm_delete = false;
 		}
 		
-		QString full_path = url.toLocalFile();
-		
-		if (full_path.startsWith(url_prefix))
-			full_path = full_path.mid(url_prefix.size());
-		
+		QString full_path = song->full_path();
 		auto path_ba = full_path.toLocal8Bit();
 		
 		if (remove(path_ba.data()) != 0)
 			mtl_status(errno);
 		
-		table_model_->removeRows(row, 1, QModelIndex());
+		rows.append(row);
+	}
+	
+	if (table_model_->RemoveRows(rows) > 0) {
+		App *app = table_model_->app();
+		app->UpdatePlaylistDuration(table_model_->playlist());
+		app->SavePlaylistEdits(table_model_->playlist());
 	}
 }
 
@@ -3,8 +3,10 @@
 #include "../App.hpp"
 #include "../audio.hh"
 #include "../audio/Meta.hpp"
+#include "../dirs.hh"
 #include "../Duration.hpp"
 #include "Playlist.hpp"
+#include "../PlaylistFile.hpp"
 #include "../Song.hpp"
 #include "SeekPane.hpp"
 #include "Table.hpp"
@@ -13,28 +15,42 @@
 #include <QTime>
 #include <gst/gst.h>
 
+#include <algorithm>
+
 namespace quince::gui {
 
+// Past this many runs of adjacent rows a removal compacts all rows
+// at once instead of signaling the view about each run.
+static const i32 MaxRunsToRemoveOneByOne = 64;
+
+// Song changes are shown at most once per frame
+static const int FlushIntervalMs = 16;
+
 TableModel::TableModel(App *app, Playlist *parent) :
 app_(app),
 QAbstractTableModel(parent),
 playlist_(parent)
 {
-	timer_ = new QTimer(this);
-	timer_->setInterval(1000);
-	connect(timer_, &QTimer::timeout, this, &TableModel::TimerHit);
-	timer_->start();
+	flush_timer_ = new QTimer(this);
+	flush_timer_->setSingleShot(true);
+	flush_timer_->setInterval(FlushIntervalMs);
+	connect(flush_timer_, &QTimer::timeout, this, &TableModel::FlushChanges);
 }
 
 TableModel::~TableModel()
 {
-	delete timer_;
-	timer_ = nullptr;
+	delete flush_timer_;
+	flush_timer_ = nullptr;
 	
 	for (auto *song: songs_)
 		delete song;
 	
 	songs_.clear();
+	
+	for (auto *file: files_)
+		delete file;
+	
+	files_.clear();
 }
 
 QModelIndex
@@ -81,7 +97,7 @@ TableModel::data(const QModelIndex &index, int role) const
 	if (role == Qt::DisplayRole)
 	{
 		if (col == Column::Name) {
-			return song->display_name();
+			return song->filename();
 		} else if (col == Column::Duration) {
 			QString s;
 			if (meta.is_duration_set()) {
@@ -172,6 +188,138 @@ TableModel::headerData(int section_i, Qt::Orientation orientation, int role) con
 	return {};
 }
 
+void
+TableModel::Changed(Song *song, const Column c1, const Column c2)
+{
+	dirty_songs_.insert(song);
+	
+	if (c1 < dirty_first_col_)
+		dirty_first_col_ = c1;
+	
+	if (c2 > dirty_last_col_)
+		dirty_last_col_ = c2;
+	
+	// Hidden to the tray nobody looks, flushed when the window is back
+	if (!flush_timer_->isActive() && app_->visible())
+		flush_timer_->start();
+}
+
+QVector<u32>
+TableModel::DirsUnder(const QString &dir_path) const
+{ // subfolders sort right after it, among siblings that start like it
+	QVector<u32> ids;
+	
+	for (auto it = dir_ids_.lowerBound(dir_path); it != dir_ids_.cend() &&
+		it.key().startsWith(dir_path); it++)
+	{
+		const QString &path = it.key();
+		
+		if (path.size() == dir_path.size() || path[dir_path.size()] == '/')
+			ids.append(it.value());
+	}
+	
+	return ids;
+}
+
+void
+TableModel::FileMoved(Song *song, const u32 dir_id, const QString &filename)
+{
+	RemoveFromDir(song);
+	song->dir_id(dir_id);
+	song->filename(filename);
+	AddToDir(song);
+	Changed(song, Column::Name, Column::Name);
+}
+
+Song*
+TableModel::Find(const u32 dir_id, const QString &filename) const
+{
+	for (Song *song: dir_songs_.value(dir_id))
+	{
+		if (song->filename() == filename)
+			return song;
+	}
+	
+	return nullptr;
+}
+
+void
+TableModel::FlushChanges()
+{
+	flush_timer_->stop();
+	
+	if (dirty_songs_.isEmpty())
+		return;
+	
+	QSet<Song*> dirty;
+	dirty.swap(dirty_songs_);
+	const Column c1 = dirty_first_col_;
+	const Column c2 = dirty_last_col_;
+	dirty_first_col_ = Column::Count;
+	dirty_last_col_ = Column::Name;
+	
+	// The rows are looked up here rather than when the songs change
+	// since rows move in between, adjacent rows are merged into one range.
+	std::vector<i32> rows;
+	rows.reserve(dirty.size());
+	
+	for (Song *song: dirty)
+	{
+		const i32 row = RowOf(song);
+		
+		if (row != -1)
+			rows.push_back(row);
+	}
+	
+	std::sort(rows.begin(), rows.end());
+	const i32 count = rows.size();
+	
+	for (i32 i = 0, first = 0; i < count; i++)
+	{
+		if (i + 1 == count || rows[i + 1] != rows[i] + 1) {
+			UpdateRange(rows[first], c1, rows[i], c2);
+			first = i + 1;
+		}
+	}
+	
+	SeekPane *seek_pane = app_->seek_pane();
+	
+	for (Song *song: dirty)
+	{
+		if (seek_pane->IsActive(song)) {
+			audio::PlaylistSong pair = {playlist_->id(), song};
+			seek_pane->SetCurrentOrUpdate(pair);
+			break;
+		}
+	}
+	
+	if (playlist_ == app_->GetVisiblePlaylist())
+		app_->UpdatePlaylistDuration(playlist_);
+}
+
+void
+TableModel::AddToDir(Song *song)
+{
+	const u32 dir_id = song->dir_id();
+	QVector<Song*> &songs = dir_songs_[dir_id];
+	
+	if (songs.isEmpty())
+		dir_ids_.insert(dirs::Get(dir_id), dir_id);
+	
+	songs.append(song);
+}
+
+void
+TableModel::Index(Song *song, const i32 row)
+{
+	song_rows_.insert(song, row);
+	AddToDir(song);
+	const io::FileID &id = song->file_id();
+	
+	if (id.Initialized())
+		file_ids_[id]++;
+}
+
 bool
 TableModel::InsertRows(const i32 at, const QVector<Song*> &songs_to_add)
 {
@@ -183,10 +331,15 @@ TableModel::InsertRows(const i32 at, const QVector<Song*> &songs_to_add)
 	
 	beginInsertRows(QModelIndex(), first, last);
 	
+	// Appending, the most common case, doesn't move any rows
+	if (at != songs_.size())
+		rows_valid_ = false;
+	
 	for (i32 i = 0; i < songs_to_add.size(); i++)
 	{
 		auto *song = songs_to_add[i];
 		songs_.insert(at + i, song);
+		Index(song, at + i);
 	}
 	
 	endInsertRows();
@@ -197,50 +350,109 @@ TableModel::InsertRows(const i32 at, const QVector<Song*> &songs_to_add)
 bool
 TableModel::removeRows(int row, int count, const QModelIndex &parent)
 {
-	if (count <= 0)
-		return false;
-	
-	if (count != 1)
-	{
-		mtl_warn("Count != 1");
+	if (count <= 0 || row < 0 || row + count > songs_.size())
 		return false;
-	}
 	
 	const int first = row;
 	const int last = row + count - 1;
 	beginRemoveRows(QModelIndex(), first, last);
 	
-	for (int i = count - 1; i >= 0; i--) {
-		const i32 index = first + i;
-		auto *item = songs_[index];
-		songs_.erase(songs_.begin() + index);
+	if (last + 1 != songs_.size())
+		rows_valid_ = false;
+	
+	for (int i = first; i <= last; i++) {
+		auto *item = songs_[i];
+		app_->ForgetPendingSong(item);
+		dirty_songs_.remove(item);
+		Unindex(item);
 		delete item;
 	}
 	
+	songs_.erase(songs_.begin() + first, songs_.begin() + last + 1);
+	playing_row_ = -1;
 	endRemoveRows();
 	return true;
 }
 
-void
-TableModel::StartOrStopTimer()
+i32
+TableModel::RemoveRows(QVector<i32> rows)
 {
-	if (playlist_->visible()) {
-		TimerHit();
-		timer_->start();
-	} else {
-		timer_->stop();
+	std::sort(rows.begin(), rows.end());
+	rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+	const i32 song_count = songs_.size();
+	
+	rows.erase(std::lower_bound(rows.begin(), rows.end(), song_count), rows.end());
+	rows.erase(rows.begin(), std::lower_bound(rows.begin(), rows.end(), 0));
+	
+	if (rows.isEmpty())
+		return 0;
+	
+	// Group the rows into runs of adjacent ones, each run is a single
+	// erase instead of one per row.
+	struct Run { i32 first; i32 count; };
+	QVector<Run> runs;
+	
+	for (const i32 row: rows)
+	{
+		if (!runs.isEmpty() && runs.last().first + runs.last().count == row)
+			runs.last().count++;
+		else
+			runs.append(Run {row, 1});
+	}
+	
+	PlaylistJournal &journal = playlist_->journal();
+	
+	if (runs.size() <= MaxRunsToRemoveOneByOne)
+	{ // from the bottom up so that the rows of the next runs stay valid
+		for (i32 i = runs.size() - 1; i >= 0; i--) {
+			const Run &run = runs[i];
+			removeRows(run.first, run.count, QModelIndex());
+			journal.Remove(run.first, run.count);
+		}
+		
+		return rows.size();
+	}
+	
+	// A scattered selection: compact everything in a single pass, which
+	// also means the view has to start over.
+	beginResetModel();
+	std::vector<u8> removed(song_count, 0);
+	
+	for (const i32 row: rows)
+		removed[row] = 1;
+	
+	i32 to = 0;
+	for (i32 from = 0; from < song_count; from++)
+	{
+		Song *song = songs_[from];
+		
+		if (removed[from]) {
+			app_->ForgetPendingSong(song);
+			dirty_songs_.remove(song);
+			Unindex(song);
+			delete song;
+		} else {
+			songs_[to++] = song;
+		}
 	}
+	
+	songs_.resize(to);
+	rows_valid_ = false;
+	playing_row_ = -1;
+	endResetModel();
+	
+	for (i32 i = runs.size() - 1; i >= 0; i--)
+		journal.Remove(runs[i].first, runs[i].count);
+	
+	return rows.size();
 }
 
 void
-TableModel::TimerHit()
-{
-	const bool is_visible = playlist_->table()->isVisible();
-	app_->UpdatePlayingSongPosition(-1, is_visible);
-	
-	if (!is_visible)
+TableModel::PositionTicked()
+{ // see GstPlayer::ClockTick()
+	if (!playlist_->table()->isVisible())
 		return;
-
+	
 	if (app_->seek_pane()->slider_dragged_by_user())
 		return;
 	
@@ -253,6 +465,57 @@ TableModel::TimerHit()
 	UpdateRange(playing_row_, Column::Duration, playing_row_, Column::Duration);
 }
 
+i32
+TableModel::RowOf(Song *song)
+{
+	if (!rows_valid_)
+	{ // once after rows moved, not per lookup
+		const i32 count = songs_.size();
+		
+		for (i32 i = 0; i < count; i++)
+			song_rows_[songs_[i]] = i;
+		
+		rows_valid_ = true;
+	}
+	
+	auto it = song_rows_.constFind(song);
+	
+	return (it == song_rows_.cend()) ? -1 : it.value();
+}
+
+void
+TableModel::RemoveFromDir(Song *song)
+{
+	const u32 dir_id = song->dir_id();
+	auto it = dir_songs_.find(dir_id);
+	
+	if (it == dir_songs_.end())
+		return;
+	
+	it->removeOne(song);
+	
+	if (it->isEmpty()) {
+		dir_songs_.erase(it);
+		dir_ids_.remove(dirs::Get(dir_id));
+	}
+}
+
+void
+TableModel::Unindex(Song *song)
+{
+	song_rows_.remove(song);
+	RemoveFromDir(song);
+	const io::FileID &id = song->file_id();
+	
+	if (!id.Initialized())
+		return;
+	
+	auto it = file_ids_.find(id);
+	
+	if (it != file_ids_.end() && --it->second == 0)
+		file_ids_.erase(it);
+}
+
 void
 TableModel::UpdateRange(int row1, Column c1, int row2, Column c2)
 {
@@ -266,6 +529,16 @@ TableModel::UpdateRange(int row1, Column c1, int row2, Column c2)
 		last = row2;
 	}
 	
+	if (!app_->visible())
+	{ // hidden to the tray, only remember them, see Changed()
+		const int max = std::min(last, songs_.size() - 1);
+		
+		for (int row = std::max(first, 0); row <= max; row++)
+			Changed(songs_[row], c1, c2);
+		
+		return;
+	}
+	
 	const QModelIndex top_left = createIndex(first, int(c1));
 	const QModelIndex bottom_right = createIndex(last, int(c2));
 	emit dataChanged(top_left, bottom_right, {Qt::DisplayRole});
@@ -3,12 +3,17 @@
 #include "decl.hxx"
 #include "../decl.hxx"
 #include "../err.hpp"
+#include "../io/io.hxx"
 #include "../types.hxx"
 
 #include <QAbstractTableModel>
+#include <QHash>
+#include <QMap>
+#include <QSet>
 #include <QTimer>
 
 #include <type_traits>
+#include <unordered_map>
 
 namespace quince::gui {
 
@@ -29,9 +34,41 @@ public:
 	TableModel(App *app, Playlist *parent);
 	virtual ~TableModel();
 	
+	void
+	AdoptFile(PlaylistFile *file) { files_.append(file); }
+	
 	App*
 	app() const { return app_; }
 	
+	// Shows the song's new info with the next batch of changes
+	void
+	Changed(Song *song, const Column c1 = Column::Name,
+		const Column c2 = Column(i8(Column::Count) - 1));
+	
+	// The ids of the folder and its subfolders that have songs in the playlist
+	QVector<u32>
+	DirsUnder(const QString &dir_path) const;
+	
+	// The song's file was renamed or moved to another folder
+	void
+	FileMoved(Song *song, const u32 dir_id, const QString &filename);
+	
+	// The song of a file by its folder and name, or nullptr
+	Song*
+	Find(const u32 dir_id, const QString &filename) const;
+	
+	// Shows the songs changed so far now
+	void
+	FlushChanges();
+	
+	// O(1), the song may have been deleted already
+	bool
+	has(Song *song) const { return song_rows_.contains(song); }
+	
+	// Whether a song of this file is in the playlist already
+	bool
+	has_file(const io::FileID &id) const { return file_ids_.count(id) > 0; }
+	
 	int
 	rowCount(const QModelIndex &parent = QModelIndex()) const override;
 	
@@ -44,6 +81,9 @@ public:
 	QVariant
 	headerData(int section, Qt::Orientation orientation, int role) const override;
 	
+	Playlist*
+	playlist() const { return playlist_; }
+	
 	QModelIndex
 	index(int row, int column, const QModelIndex &parent) const override;
 	
@@ -60,6 +100,13 @@ public:
 		return true;
 	}
 	virtual bool removeRows(int row, int count, const QModelIndex &parent) override;
+	
+	i32
+	RemoveRows(QVector<i32> rows); // any order, records them in the journal
+	
+	i32
+	RowOf(Song *song); // -1 if it isn't in the playlist
+	
 	virtual bool removeColumns(int column, int count, const QModelIndex &parent) override {
 		mtl_trace();
 		return true;
@@ -68,7 +115,12 @@ public:
 	QVector<Song*>&
 	songs() { return songs_; }
 	
-	void StartOrStopTimer();
+	// A copy, it can be iterated while moving the songs to other folders
+	QVector<Song*>
+	SongsIn(const u32 dir_id) const { return dir_songs_.value(dir_id); }
+	
+	// The playing song's position changed, refreshes its row
+	void PositionTicked();
 	
 	void
 	UpdateRange(int row1, Column c1, int row2, Column c2);
@@ -86,14 +138,26 @@ public:
 	
 private:
 	
-	void TimerHit();
+	void AddToDir(Song *song);
+	void Index(Song *song, const i32 row);
+	void RemoveFromDir(Song *song);
+	void Unindex(Song *song);
 	bool UpdatePlayingSongPosition();
 	
 	Playlist *playlist_ = nullptr;
 	App *app_ = nullptr;
 	QVector<Song*> songs_;
-	QTimer *timer_ = nullptr;
+	QVector<PlaylistFile*> files_; // mapped files the songs read from
+	QTimer *flush_timer_ = nullptr;
+	QSet<Song*> dirty_songs_;
+	QHash<Song*, i32> song_rows_; // the songs_ by handle, see rows_valid_
+	QHash<u32, QVector<Song*>> dir_songs_; // by folder id
+	QMap<QString, u32> dir_ids_; // the folders of dir_songs_ by path
+	std::unordered_map<io::FileID, i32, io::FileIDHash> file_ids_; // songs per file
+	Column dirty_first_col_ = Column::Count;
+	Column dirty_last_col_ = Column::Name;
 	mutable int playing_row_ = -1;
+	bool rows_valid_ = true; // song_rows_ has the rows, else rebuilt on use
 };
 
 
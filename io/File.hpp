@@ -19,6 +19,7 @@ public:
 	QString name;
 	QString dir_path;
 	i64 size = -1;
+	i64 mtime = -1; // nanoseconds
 	FileType type_ = FileType::Unknown;
 	FileID id;
 };
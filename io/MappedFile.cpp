@@ -0,0 +1,60 @@
+#include "MappedFile.hpp"
+
+#include "io.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace quince::io {
+
+MappedFile::MappedFile() {}
+
+MappedFile::~MappedFile()
+{
+	if (data_ != nullptr) {
+		munmap(const_cast<char*>(data_), size_);
+		data_ = nullptr;
+	}
+}
+
+io::Err
+MappedFile::Open(const QString &full_path)
+{
+	if (data_ != nullptr)
+		mtl_trace();
+	
+	auto path = full_path.toLocal8Bit();
+	const int fd = open(path.data(), O_RDONLY);
+	
+	if (fd == -1)
+		return MapPosixError(errno);
+	
+	struct stat st;
+	
+	if (fstat(fd, &st) != 0) {
+		io::Err e = MapPosixError(errno);
+		close(fd);
+		return e;
+	}
+	
+	if (st.st_size == 0) {
+		close(fd);
+		return Err::Other;
+	}
+	
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	io::Err e = (p == MAP_FAILED) ? MapPosixError(errno) : Err::Ok;
+	close(fd); // the mapping stays valid
+	
+	if (e != Err::Ok)
+		return e;
+	
+	data_ = static_cast<const char*>(p);
+	size_ = st.st_size;
+	
+	return Err::Ok;
+}
+
+}
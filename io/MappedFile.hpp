@@ -0,0 +1,33 @@
+#pragma once
+
+#include "io.hxx"
+#include "../err.hpp"
+
+namespace quince::io {
+
+// A read-only, private memory mapping of a whole file.
+class MappedFile {
+public:
+	MappedFile();
+	virtual ~MappedFile();
+	
+	const char*
+	data() const { return data_; }
+	
+	bool
+	is_open() const { return data_ != nullptr; }
+	
+	io::Err
+	Open(const QString &full_path);
+	
+	i64
+	size() const { return size_; }
+
+private:
+	NO_ASSIGN_COPY_MOVE(MappedFile);
+	
+	const char *data_ = nullptr;
+	i64 size_ = 0;
+};
+
+}
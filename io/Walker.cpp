@@ -0,0 +1,320 @@
+#include "Walker.hpp"
+
+#include "io.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace quince::io {
+
+walk::OpenDir::~OpenDir()
+{
+	if (dp != nullptr)
+		closedir(dp);
+}
+
+Walker::Walker(const WalkOptions &options) : options_(options) {}
+
+Walker::~Walker() {}
+
+bool
+Walker::Emit(walk::Dir &dir, QByteArray &dir_path, const WalkFunc &func)
+{ // dir_path grows and shrinks back as the callback goes through the tree
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		done_cv_.wait(lock, [&dir] { return dir.done; });
+	}
+	
+	WalkEntry entry;
+	entry.dir_path = &dir_path;
+	entry.depth = dir.depth;
+	
+	for (const walk::File &file: dir.files)
+	{
+		entry.name = file.name.data();
+		entry.name_len = file.name.size();
+		entry.st = &file.st;
+		
+		if (!func(entry))
+			return false;
+	}
+	
+	for (std::unique_ptr<walk::Dir> &subdir: dir.subdirs)
+	{
+		const int len = dir_path.size();
+		dir_path.append('/');
+		dir_path.append(subdir->name);
+		const bool go_on = Emit(*subdir, dir_path, func);
+		dir_path.truncate(len);
+		
+		if (!go_on)
+			return false;
+		
+		subdir.reset(); // it's done, nobody else refers to it
+	}
+	
+	return true;
+}
+
+void
+Walker::ListDir(walk::Dir &dir)
+{
+	int parent_fd = AT_FDCWD;
+	int open_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+	
+	if (dir.parent != nullptr) {
+		parent_fd = dirfd(dir.parent->dp);
+		
+		if (!options_.follow_symlinks)
+			open_flags |= O_NOFOLLOW;
+	}
+	
+	const char *dir_name = dir.name.isEmpty() ? "/" : dir.name.data();
+	const int fd = openat(parent_fd, dir_name, open_flags);
+	dir.parent.reset(); // the last subfolder to be opened closes it
+	
+	if (fd == -1)
+		return;
+	
+	struct stat st;
+	
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return;
+	}
+	
+	{ // a symlink cycle or a folder listed already
+		std::lock_guard<std::mutex> guard(mutex_);
+		const FileID id = { .device_id = st.st_dev, .inode_number = st.st_ino };
+		
+		if (!visited_.insert(id).second) {
+			close(fd);
+			return;
+		}
+	}
+	
+	DIR *dp = fdopendir(fd);
+	
+	if (dp == nullptr) {
+		close(fd);
+		return;
+	}
+	
+	const int dir_fd = dirfd(dp);
+	const bool descend = dir.depth + 1 < options_.max_depth;
+	const int stat_flags = options_.follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW;
+	std::vector<QByteArray> subdir_names;
+	struct dirent *entry;
+	
+	while ((entry = readdir(dp)) != nullptr)
+	{
+		const char *name = entry->d_name;
+		
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+			continue;
+		
+		const usize name_len = strlen(name);
+		const bool wanted = options_.filter == nullptr ||
+			options_.filter(name, name_len);
+		unsigned char type = entry->d_type;
+		
+		if (type == DT_LNK) {
+			if (!options_.follow_symlinks)
+				continue;
+			type = DT_UNKNOWN; // the target decides
+		}
+		
+		if (type == DT_DIR) {
+			if (descend)
+				subdir_names.push_back(QByteArray(name, name_len));
+			continue;
+		}
+		
+		if (type != DT_REG && type != DT_UNKNOWN)
+			continue;
+		
+		if (!wanted && (type == DT_REG || !descend))
+			continue; // no need to stat() it
+		
+		if (fstatat(dir_fd, name, &st, stat_flags) != 0)
+			continue;
+		
+		if (S_ISDIR(st.st_mode)) {
+			if (descend)
+				subdir_names.push_back(QByteArray(name, name_len));
+			continue;
+		}
+		
+		if (S_ISREG(st.st_mode) && wanted)
+			dir.files.push_back(walk::File {QByteArray(name, name_len), st});
+	}
+	
+	// "track 2" before "track 10"
+	std::sort(dir.files.begin(), dir.files.end(),
+	[] (const walk::File &a, const walk::File &b) {
+		return strverscmp(a.name.data(), b.name.data()) < 0;
+	});
+	
+	std::sort(subdir_names.begin(), subdir_names.end(),
+	[] (const QByteArray &a, const QByteArray &b) {
+		return strverscmp(a.data(), b.data()) < 0;
+	});
+	
+	if (subdir_names.empty()) {
+		closedir(dp);
+		return;
+	}
+	
+	auto open_dir = std::make_shared<walk::OpenDir>();
+	open_dir->dp = dp;
+	
+	for (const QByteArray &name: subdir_names)
+	{
+		auto subdir = std::make_unique<walk::Dir>();
+		subdir->name = name;
+		subdir->parent = open_dir;
+		subdir->depth = dir.depth + 1;
+		dir.subdirs.push_back(std::move(subdir));
+	}
+}
+
+walk::Dir*
+Walker::Take(const int worker)
+{ // own folders newest first, stolen ones oldest first
+	std::deque<walk::Dir*> &own = queues_[worker];
+	
+	if (!own.empty()) {
+		walk::Dir *dir = own.back();
+		own.pop_back();
+		return dir;
+	}
+	
+	const int count = queues_.size();
+	
+	for (int i = 1; i < count; i++)
+	{
+		std::deque<walk::Dir*> &other = queues_[(worker + i) % count];
+		
+		if (!other.empty()) {
+			walk::Dir *dir = other.front();
+			other.pop_front();
+			return dir;
+		}
+	}
+	
+	return nullptr;
+}
+
+io::Err
+Walker::Walk(const QVector<QString> &dir_paths, const WalkFunc &func)
+{
+	std::vector<std::unique_ptr<walk::Dir>> roots;
+	io::Err err = Err::Ok;
+	
+	for (const QString &dir_path: dir_paths)
+	{
+		auto root = std::make_unique<walk::Dir>();
+		root->name = dir_path.toLocal8Bit();
+		const int fd = open(root->name.data(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		
+		if (fd == -1) {
+			if (err == Err::Ok)
+				err = MapPosixError(errno);
+			continue;
+		}
+		
+		close(fd);
+		
+		while (root->name.endsWith('/'))
+			root->name.chop(1);
+		
+		roots.push_back(std::move(root));
+	}
+	
+	if (roots.empty())
+		return err;
+	
+	const int worker_count = std::max(1, options_.threads);
+	queues_.assign(worker_count, std::deque<walk::Dir*>());
+	
+	// Backwards, like subfolders, so that the first tree is listed first
+	for (auto it = roots.rbegin(); it != roots.rend(); it++)
+		queues_[0].push_back(it->get());
+	
+	unfinished_ = roots.size();
+	stop_ = false;
+	
+	std::vector<std::thread> workers;
+	
+	for (int i = 0; i < worker_count; i++)
+		workers.emplace_back(&Walker::Work, this, i);
+	
+	for (std::unique_ptr<walk::Dir> &root: roots)
+	{
+		QByteArray dir_path = root->name;
+		
+		if (!Emit(*root, dir_path, func)) {
+			std::lock_guard<std::mutex> guard(mutex_);
+			stop_ = true;
+			break;
+		}
+		
+		root.reset();
+	}
+	
+	work_cv_.notify_all();
+	
+	for (std::thread &t: workers)
+		t.join();
+	
+	queues_.clear();
+	
+	return err;
+}
+
+void
+Walker::Work(const int worker)
+{
+	while (true)
+	{
+		walk::Dir *dir = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			work_cv_.wait(lock, [this, worker, &dir] {
+				if (stop_ || unfinished_ == 0)
+					return true;
+				dir = Take(worker);
+				return dir != nullptr;
+			});
+			
+			if (dir == nullptr)
+				return;
+		}
+		
+		ListDir(*dir);
+		
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			std::deque<walk::Dir*> &own = queues_[worker];
+			
+			// Pushed backwards so that the first subfolder gets taken
+			// first, it's the one the callback needs next.
+			for (auto it = dir->subdirs.rbegin(); it != dir->subdirs.rend(); it++)
+				own.push_back(it->get());
+			
+			unfinished_ += i64(dir->subdirs.size()) - 1;
+			dir->done = true;
+		}
+		
+		work_cv_.notify_all();
+		done_cv_.notify_all();
+	}
+}
+
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "io.hxx"
+#include "../err.hpp"
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include <condition_variable>
+#include <dirent.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace quince::io {
+
+// A file found by the Walker, only valid during the callback.
+struct WalkEntry {
+	const QByteArray *dir_path = nullptr; // no trailing slash
+	const char *name = nullptr;
+	usize name_len = 0;
+	const struct stat *st = nullptr;
+	int depth = 0; // 0 for the files right inside the starting folder
+};
+
+// Returns false to stop the walk.
+typedef std::function<bool (const WalkEntry &entry)> WalkFunc;
+
+// Cheap check on the raw file name, before the file gets stat()ed.
+typedef bool (*NameFilter)(const char *name, const usize len);
+
+struct WalkOptions {
+	int max_depth = 3; // how many folder levels to list, 1 = no subfolders
+	int threads = 1; // folders listed at the same time
+	bool follow_symlinks = true;
+	NameFilter filter = nullptr;
+};
+
+namespace walk {
+
+struct File {
+	QByteArray name;
+	struct stat st;
+};
+
+// A listed folder kept open while its subfolders wait to be opened
+// relative to it, closed along with the last of them.
+struct OpenDir {
+	DIR *dp = nullptr;
+	~OpenDir();
+};
+
+struct Dir {
+	QByteArray name; // the path for the starting folders
+	std::shared_ptr<OpenDir> parent; // nullptr for the starting folders
+	int depth = 0;
+	std::vector<File> files; // sorted
+	std::vector<std::unique_ptr<Dir>> subdirs; // sorted
+	bool done = false;
+};
+
+}
+
+/* Lists the regular files of folder trees without building a path per
+ file: the entry type comes from d_type when the file system provides
+ it, files are stat()ed and subfolders opened relative to their folder's
+ descriptor and names are handed out as raw bytes.
+ Folders are listed by several threads, each taking the subfolders it
+ found first and stealing from the others when it runs out, which hides
+ the latency of network file systems and spinning disks. The callback
+ still runs on the calling thread and sees the files in a fixed order:
+ a folder's files sorted by name, then its subfolders the same way.
+ Folders reached twice (through symlinks or overlapping starting
+ folders) are only listed once. */
+class Walker {
+public:
+	Walker(const WalkOptions &options);
+	virtual ~Walker();
+	
+	// The trees are listed by one pool of threads and handed to func in
+	// the order of dir_paths. Returns the error of the first one that
+	// couldn't be opened, the others are walked anyway.
+	io::Err
+	Walk(const QVector<QString> &dir_paths, const WalkFunc &func);
+
+private:
+	NO_ASSIGN_COPY_MOVE(Walker);
+	
+	bool
+	Emit(walk::Dir &dir, QByteArray &dir_path, const WalkFunc &func);
+	
+	void
+	ListDir(walk::Dir &dir);
+	
+	walk::Dir*
+	Take(const int worker);
+	
+	void
+	Work(const int worker);
+	
+	WalkOptions options_;
+	std::unordered_set<FileID, FileIDHash> visited_;
+	
+	// Used during a Walk():
+	std::mutex mutex_;
+	std::condition_variable work_cv_;
+	std::condition_variable done_cv_;
+	std::vector<std::deque<walk::Dir*>> queues_; // one per worker
+	i64 unfinished_ = 0; // folders queued or being listed
+	bool stop_ = false;
+};
+
+}
@@ -1,18 +1,66 @@
 #include "io.hh"
 
 #include "File.hpp"
+#include "../audio.hh"
 #include "../err.hpp"
 #include "../ByteArray.hpp"
 
-#include <QDir>
-#include <QFileInfo>
-
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 
 namespace quince::io {
 
+usize
+FileIDHash::operator()(const FileID &id) const
+{
+	u64 h = u64(id.inode_number);
+	h = h * 0x9E3779B97F4A7C15ull ^ u64(id.device_id);
+	return usize(h ^ (h >> 29));
+}
+
+io::Err
+AppendToFile(const QString &full_path, const char *data, const i64 size,
+	const bool truncate, const bool sync)
+{
+	auto path = full_path.toLocal8Bit();
+	int flags = O_WRONLY | O_CREAT | O_APPEND;
+	
+	if (truncate)
+		flags |= O_TRUNC;
+	
+	const int fd = open(path.data(), flags, io::FilePermissions);
+	
+	if (fd == -1)
+		return MapPosixError(errno);
+	
+	isize written = 0;
+	
+	while (written < size) {
+		isize ret = write(fd, data + written, size - written);
+		
+		if (ret == -1) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			io::Err e = MapPosixError(errno);
+			close(fd);
+			return e;
+		}
+		
+		written += ret;
+	}
+	
+	if (sync && fsync(fd) != 0) {
+		io::Err e = MapPosixError(errno);
+		close(fd);
+		return e;
+	}
+	
+	close(fd);
+	
+	return Err::Ok;
+}
+
 bool
 EnsureDir(const QString &dir_path, const QString &subdir)
 {
@@ -64,9 +112,15 @@ FileFromPath(io::File &file, const QString &full_path)
 	if (lstat(ba.data(), &st) == -1)
 		return MapPosixError(errno);
 	
-	QFileInfo info(full_path);
-	const QString parent_dir = info.dir().absolutePath();
-	FillIn(file, st, parent_dir, info.fileName());
+	// Splitting the path by hand, QFileInfo would stat() it again
+	QString path = full_path;
+	
+	while (path.size() > 1 && path.endsWith('/'))
+		path.chop(1);
+	
+	const int slash = path.lastIndexOf('/');
+	const QString parent_dir = (slash > 0) ? path.left(slash) : QString("/");
+	FillIn(file, st, parent_dir, path.mid(slash + 1));
 	
 	return io::Err::Ok;
 }
@@ -79,6 +133,7 @@ FillIn(io::File &file, const struct stat &st, const QString &dir_path,
 	file.name = name;
 	file.dir_path = dir_path;
 	file.size = st.st_size;
+	file.mtime = i64(st.st_mtim.tv_sec) * 1000000000L + st.st_mtim.tv_nsec;
 	file.type_ = MapPosixTypeToLocal(st.st_mode);
 	file.id = io::FileID {
 		.device_id = st.st_dev,
@@ -100,18 +155,13 @@ GetFilenameExtension(const QString &name)
 bool
 IsSongExtension(const QString &dir_path, const QString &filename)
 {
-	QStringRef ext_ref = io::GetFilenameExtension(filename);
-	
-	if (ext_ref.isEmpty())
-		return false;
-	
-	QString ext = ext_ref.toString().toLower();
-	
-	if (ext == "mp3" || ext == "opus" || ext == "flac"
-		|| ext == "mka" || ext == "m4a" || ext == "webm")
-		return true;
-	
-	return false;
+	return audio::CodecFromFileName(filename) != audio::Codec::Unknown;
+}
+
+bool
+IsSongFileName(const char *name, const usize len)
+{
+	return audio::CodecFromFileName(name, len) != audio::Codec::Unknown;
 }
 
 io::Err
@@ -253,7 +303,47 @@ ReadFile(const QString &full_path, quince::ByteArray &buffer)
 }
 
 io::Err
-WriteToFile(const QString &full_path, const char *data, const i64 size)
+ReplaceFile(const QString &full_path, const char *data, const i64 size)
+{
+	// Write a new file and rename it over the old one, so that
+	// whoever has the old file open or mapped keeps its contents
+	// and a crash leaves either the old or the new file behind.
+	const QString temp_path = full_path + QLatin1String(".tmp");
+	auto from = temp_path.toLocal8Bit();
+	io::Err e = WriteToFile(temp_path, data, size, true);
+	
+	if (e != Err::Ok) {
+		remove(from.data());
+		return e;
+	}
+	
+	auto to = full_path.toLocal8Bit();
+	
+	if (rename(from.data(), to.data()) != 0) {
+		e = MapPosixError(errno);
+		remove(from.data());
+		return e;
+	}
+	
+	// Make the rename itself durable
+	const int slash = full_path.lastIndexOf('/');
+	
+	if (slash > 0) {
+		auto dir_path = full_path.left(slash).toLocal8Bit();
+		const int fd = open(dir_path.data(), O_RDONLY | O_DIRECTORY);
+		
+		if (fd != -1) {
+			fsync(fd);
+			close(fd);
+		}
+	}
+	
+	return Err::Ok;
+}
+
+io::Err
+WriteToFile(const QString &full_path, const char *data, const i64 size,
+	const bool sync)
 {
 	auto path = full_path.toLocal8Bit();
 	const int fd = open(path.data(), O_WRONLY | O_CREAT | O_TRUNC,
@@ -279,6 +369,12 @@ WriteToFile(const QString &full_path, const char *data, const i64 size)
 		written += ret;
 	}
 	
+	if (sync && fsync(fd) != 0) {
+		io::Err e = MapPosixError(errno);
+		close(fd);
+		return e;
+	}
+	
 	close(fd);
 	
 	return Err::Ok;
@@ -19,6 +19,10 @@ namespace quince::io {
 
 typedef bool (*FilterFunc)(const QString &dir_path, const QString &name);
 
+io::Err
+AppendToFile(const QString &full_path, const char *data, const i64 size,
+	const bool truncate = false, const bool sync = false);
+
 bool
 EnsureDir(const QString &dir_path, const QString &subdir);
 
@@ -37,6 +41,9 @@ GetFilenameExtension(const QString &name);
 bool
 IsSongExtension(const QString &dir_path, const QString &filename);
 
+bool
+IsSongFileName(const char *name, const usize len);
+
 io::Err
 ListFileNames(const QString &full_dir_path, QVector<QString> &vec);
 
@@ -65,6 +72,10 @@ io::Err
 ReadFile(const QString &full_path, quince::ByteArray &buffer);
 
 io::Err
-WriteToFile(const QString &full_path, const char *data, const i64 size);
+ReplaceFile(const QString &full_path, const char *data, const i64 size);
+
+io::Err
+WriteToFile(const QString &full_path, const char *data, const i64 size,
+	const bool sync = false);
 
 }
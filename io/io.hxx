@@ -52,6 +52,10 @@ struct FileID {
 	}
 };
 
+struct FileIDHash {
+	usize operator()(const FileID &id) const;
+};
+
 enum class ListOptions : u8 {
 	HiddenFiles = 1u << 0,
 };